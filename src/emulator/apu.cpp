@@ -8,74 +8,558 @@
 
 #include "apu.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "cgb.h"
+#include "savestate.h"
 #include "types.h"
 
+// pulse duty cycles, one bit per waveform step
+const uint8 APU::dutyWaveforms[4] = {0x01, 0x81, 0x87, 0x7E};
+
+// wave channel shifts for each NR32 output level
+const uint8 APU::waveShifts[4] = {4, 0, 1, 2};
+
 APU::APU()
-    : cgb(nullptr), sweepCycles(), lengthCycles(), channel1CurrSweepPace() {}
-
-void APU::step() {
-  sweepCycles = {0.0, 0.0, 0.0, 0.0};
-  lengthCycles = {0.0, 0.0, 0.0, 0.0};
-
-  if (soundOn()) {
-    channel1Step();
-    channel2Step();
-    channel3Step();
-    channel4Step();
-  } else {
-    sweepCycles = {0.0, 0.0, 0.0, 0.0};
-    lengthCycles = {0.0, 0.0, 0.0, 0.0};
+    : channels(),
+      sweepTimer(0),
+      sweepShadow(0),
+      sweepEnabled(false),
+      lfsr(0),
+      sequencerStep(0),
+      lastClock(0),
+      nextSequencerClock(FRAME_SEQUENCER_CYCLES),
+      frameStartClock(0),
+      framePhase(0),
+      sampleStep(((uint64)AUDIO_SAMPLE_RATE << 32) / T_CYCLES_PER_SEC),
+      kernel(),
+      deltasLeft(),
+      deltasRight(),
+      sumLeft(0),
+      sumRight(0),
+      dcLeft(0),
+      dcRight(0),
+      samples(),
+      sampleCount(0),
+      stemDeltas(),
+      stemSums(),
+      stemDcs(),
+      stemSamples(),
+      stemsEnabled(false),
+      observer(nullptr),
+      cgb(nullptr),
+      ring(),
+      audioSync(false),
+      muted(false) {
+  buildKernel();
+}
+
+// build windowed sinc kernels, each phase is
+// normalized so a full step integrates to 1
+void APU::buildKernel() {
+  const double pi = acos(-1.0);
+  for (int phase = 0; phase < BLIP_PHASES; ++phase) {
+    double sum = 0;
+    array<double, BLIP_TAPS> taps;
+    for (int i = 0; i < BLIP_TAPS; ++i) {
+      double x = i - (BLIP_TAPS / 2 - 1) - (double)phase / BLIP_PHASES;
+      double t = pi * x * BLIP_CUTOFF;
+      double sinc = t == 0 ? 1 : sin(t) / t;
+      double window = 0.5 + 0.5 * cos(pi * x / (BLIP_TAPS / 2));
+      taps[i] = sinc * window;
+      sum += taps[i];
+    }
+    for (int i = 0; i < BLIP_TAPS; ++i) kernel[phase][i] = taps[i] / sum;
+  }
+}
+
+void APU::reset() {
+  channels = {};
+  channels[3].period = channel4Period();
+  sweepTimer = 0;
+  sweepShadow = 0;
+  sweepEnabled = false;
+  lfsr = 0;
+  sequencerStep = 0;
+  lastClock = cgb->masterClock;
+  nextSequencerClock = lastClock + FRAME_SEQUENCER_CYCLES;
+  frameStartClock = lastClock;
+  framePhase = 0;
+  deltasLeft.fill(0);
+  deltasRight.fill(0);
+  sumLeft = sumRight = dcLeft = dcRight = 0;
+  sampleCount = 0;
+  for (auto &deltas : stemDeltas) deltas.fill(0);
+  stemSums.fill(0);
+  stemDcs.fill(0);
+}
+
+// save channel and sequencer state along with the
+// synthesis buffers of the current frame, so audio
+// continues without a click after loading
+void APU::saveState(StateWriter &state) const {
+  state.beginSection(APU_SECTION);
+  state.write(channels);
+  state.write(sweepTimer);
+  state.write(sweepShadow);
+  state.write(sweepEnabled);
+  state.write(lfsr);
+  state.write(sequencerStep);
+  state.write(lastClock);
+  state.write(nextSequencerClock);
+  state.write(frameStartClock);
+  state.write(framePhase);
+  state.write(deltasLeft);
+  state.write(deltasRight);
+  state.write(sumLeft);
+  state.write(sumRight);
+  state.write(dcLeft);
+  state.write(dcRight);
+  state.endSection();
+}
+
+// stems are not saved, they restart from the
+// loaded channel levels
+void APU::loadState(StateReader &state) {
+  state.read(channels);
+  state.read(sweepTimer);
+  state.read(sweepShadow);
+  state.read(sweepEnabled);
+  state.read(lfsr);
+  state.read(sequencerStep);
+  state.read(lastClock);
+  state.read(nextSequencerClock);
+  state.read(frameStartClock);
+  state.read(framePhase);
+  state.read(deltasLeft);
+  state.read(deltasRight);
+  state.read(sumLeft);
+  state.read(sumRight);
+  state.read(dcLeft);
+  state.read(dcRight);
+  sampleCount = 0;
+  for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+    stemDeltas[idx].fill(0);
+    stemSums[idx] = stemDcs[idx] = channels[idx].level * APU_VOLUME_SCALE * 8;
+  }
+}
+
+// **************************************************
+// **************************************************
+// Synthesis Functions
+// **************************************************
+// **************************************************
+
+// synthesize up to the current master clock,
+// called before any sound register changes
+void APU::catchUp() { run(cgb->masterClock); }
+
+// turn the level changes of the current frame
+// into samples, called at the end of each frame
+void APU::endFrame() {
+  run(cgb->masterClock);
+  finishFrame();
+}
+
+const int16 *APU::frameSamples() const { return samples.data(); }
+
+uint32 APU::frameSampleCount() const { return sampleCount; }
+
+// attach capture observer, stems are synthesized
+// from the next level change onwards
+void APU::attachObserver(APUObserver *apuObserver, bool stems) {
+  stemsEnabled = stems;
+  observer.store(apuObserver, memory_order_release);
+}
+
+// detach capture observer
+void APU::detachObserver() {
+  observer.store(nullptr, memory_order_release);
+  stemsEnabled = false;
+}
+
+// advance channels in bulk between frame
+// sequencer steps, only level changes do work
+void APU::run(uint64 target) {
+  while (lastClock < target) {
+    uint64 next = min({target, nextSequencerClock,
+                       frameStartClock + APU_MAX_FRAME_CYCLES});
+    if (soundOn()) {
+      for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) runChannel(idx, next);
+    }
+    lastClock = next;
+
+    if (lastClock == nextSequencerClock) {
+      stepSequencer();
+      nextSequencerClock += FRAME_SEQUENCER_CYCLES;
+    }
+    if (lastClock - frameStartClock >= APU_MAX_FRAME_CYCLES) finishFrame();
+  }
+}
+
+// step channel waveform until end time
+void APU::runChannel(uint8 idx, uint64 end) {
+  channel_t &ch = channels[idx];
+  // a zero period would never advance the timer
+  if (!ch.enabled || ch.period == 0) return;
+
+  uint64 time = lastClock;
+  uint32 remaining = end - time;
+  while (ch.timer <= remaining) {
+    time += ch.timer;
+    remaining -= ch.timer;
+    ch.timer = ch.period;
+
+    if (idx < 2) {
+      uint8 duty = idx == 0 ? channel1WaveDuty() : channel2WaveDuty();
+      ch.step = (ch.step + 1) & 7;
+      ch.output = (dutyWaveforms[duty] >> ch.step) & 1;
+    } else if (idx == 2) {
+      ch.step = (ch.step + 1) & FIVE_BITS_MASK;
+      uint8 byte = cgb->mem.getByte(WAVE_RAM + ch.step / 2);
+      ch.output = ch.step & 1 ? byte & NIBBLE_MASK : byte >> 4;
+    } else {
+      // output is the inverse of bit 0, a 7-bit
+      // lfsr also feeds back into bit 6
+      uint16 feedback = (lfsr ^ (lfsr >> 1)) & 1;
+      lfsr = (lfsr >> 1) | (feedback << 14);
+      if (lfsrWidth()) lfsr = (lfsr & ~BIT6_MASK) | (feedback << 6);
+      ch.output = ~lfsr & 1;
+    }
+    updateOutput(idx, time);
+  }
+  ch.timer -= remaining;
+}
+
+// 512 hz frame sequencer, clocks length counters
+// at 256 hz, sweep at 128 hz and envelopes at 64 hz
+void APU::stepSequencer() {
+  if ((sequencerStep & 1) == 0) {
+    for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+      channel_t &ch = channels[idx];
+      if (ch.lengthEnabled && ch.length > 0 && --ch.length == 0) {
+        disableChannel(idx);
+      }
+    }
+  }
+
+  if ((sequencerStep == 2 || sequencerStep == 6) && sweepTimer > 0 &&
+      --sweepTimer == 0) {
+    uint8 pace = channel1SweepPace();
+    sweepTimer = pace ? pace : 8;
+    if (sweepEnabled && pace) {
+      uint16 wavelength = sweepCalculation();
+      if (wavelength <= WAVELENGTH_MAX && channel1SweepSlope()) {
+        sweepShadow = wavelength;
+        setChannel1Wavelength(wavelength);
+        channels[0].period = (WAVELENGTH_MAX + 1 - wavelength) * 4;
+        sweepCalculation();
+      }
+    }
+  }
+
+  if (sequencerStep == 7) {
+    for (uint8 idx : {0, 1, 3}) {
+      channel_t &ch = channels[idx];
+      if (ch.envelopePace && --ch.envelopeTimer == 0) {
+        ch.envelopeTimer = ch.envelopePace;
+        if (ch.envelopeIncrease && ch.volume < NIBBLE_MASK) ++ch.volume;
+        if (!ch.envelopeIncrease && ch.volume > 0) --ch.volume;
+        updateOutput(idx, lastClock);
+      }
+    }
+  }
+
+  sequencerStep = (sequencerStep + 1) & 7;
+}
+
+// for wavelength L at time t and
+// sweep slope n:
+// L{t+1} = L{t} ± (L{t} / (2 ^ n))
+uint16 APU::sweepCalculation() {
+  uint16 delta = sweepShadow >> channel1SweepSlope();
+  uint16 wavelength = channel1IncreaseSweep() ? sweepShadow + delta
+                                              : sweepShadow - delta;
+  if (wavelength > WAVELENGTH_MAX) disableChannel(0);
+  return wavelength;
+}
+
+// digital output of channel before mixing
+uint8 APU::amplitude(uint8 idx) {
+  channel_t &ch = channels[idx];
+  if (!ch.enabled || !ch.dacEnabled) return 0;
+  if (idx == 2) return ch.output >> waveShifts[channel3OutputLevel()];
+  return ch.output ? ch.volume : 0;
+}
+
+// mix channel into left and right outputs
+// with NR51 panning and NR50 volume, any
+// change is added as a band-limited step
+void APU::updateOutput(uint8 idx, uint64 time) {
+  channel_t &ch = channels[idx];
+  uint8 panning = cgb->mem.getByte(NR51);
+  int level = amplitude(idx);
+  int left = (panning >> (idx + 4)) & 1 ? level * (leftVolume() + 1) : 0;
+  int right = (panning >> idx) & 1 ? level * (rightVolume() + 1) : 0;
+  if (left != ch.left || right != ch.right) {
+    addDelta(time, left - ch.left, right - ch.right);
+    ch.left = left;
+    ch.right = right;
+  }
+  if (level != ch.level) {
+    if (stemsEnabled) addStemDelta(idx, time, level - ch.level);
+    ch.level = level;
+  }
+}
+
+void APU::addDelta(uint64 time, int left, int right) {
+  uint64 pos = (time - frameStartClock) * sampleStep + framePhase;
+  const float *taps =
+      kernel[(pos >> BLIP_PHASE_SHIFT) & (BLIP_PHASES - 1)].data();
+  float *outLeft = &deltasLeft[pos >> 32];
+  float *outRight = &deltasRight[pos >> 32];
+  float scaledLeft = left * APU_VOLUME_SCALE;
+  float scaledRight = right * APU_VOLUME_SCALE;
+  for (int i = 0; i < BLIP_TAPS; ++i) {
+    outLeft[i] += scaledLeft * taps[i];
+    outRight[i] += scaledRight * taps[i];
   }
 }
 
-void APU::channel1Step() {
-  if (channel1On()) {
-    // update sweep and length cycles
-    sweepCycles[0] += cgb->doubleSpeedMode ? 0.5 : 1.0;
-    lengthCycles[0] += cgb->doubleSpeedMode ? 0.5 : 1.0;
+// stems are scaled as if the channel was
+// panned to one side at full master volume
+void APU::addStemDelta(uint8 idx, uint64 time, int delta) {
+  uint64 pos = (time - frameStartClock) * sampleStep + framePhase;
+  const float *taps =
+      kernel[(pos >> BLIP_PHASE_SHIFT) & (BLIP_PHASES - 1)].data();
+  float *out = &stemDeltas[idx][pos >> 32];
+  float scaled = delta * APU_VOLUME_SCALE * 8;
+  for (int i = 0; i < BLIP_TAPS; ++i) out[i] += scaled * taps[i];
+}
+
+// integrate deltas into samples, removing dc
+// offset, carry kernel tails to next frame and
+// queue the samples for the audio device
+void APU::finishFrame() {
+  uint64 pos = (lastClock - frameStartClock) * sampleStep + framePhase;
+  sampleCount = pos >> 32;
+
+  integrate(deltasLeft.data(), sampleCount, sumLeft, dcLeft, &samples[0], 2);
+  integrate(deltasRight.data(), sampleCount, sumRight, dcRight, &samples[1], 2);
+  if (stemsEnabled) {
+    for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+      integrate(stemDeltas[idx].data(), sampleCount, stemSums[idx],
+                stemDcs[idx], stemSamples[idx].data(), 1);
+    }
+  }
+
+  auto carry = [this](delta_buffer_t &deltas) {
+    copy(deltas.begin() + sampleCount, deltas.begin() + sampleCount + BLIP_TAPS,
+         deltas.begin());
+    fill(deltas.begin() + BLIP_TAPS, deltas.end(), 0);
+  };
+  carry(deltasLeft);
+  carry(deltasRight);
+  if (stemsEnabled) {
+    for (auto &deltas : stemDeltas) carry(deltas);
+  }
 
-    // sweep iteration
-    uint16 sweepIterCycles = channel1CurrSweepPace * CYCLES_PER_TICK;
-    if (sweepCycles[0] >= sweepIterCycles) {
-      sweepCycles[0] = fmod(sweepCycles[0], sweepIterCycles);
-      channel1CurrSweepPace = channel1SweepPace();
+  frameStartClock = lastClock;
+  framePhase = pos & 0xFFFFFFFF;
+  if (muted) return;
+  ring.write(samples.data(), sampleCount * 2);
 
-      // update wavelength if sweep slope
-      // is non-zero
-      if (channel1SweepSlope() != 0) updateChannel1Wavelength();
+  APUObserver *apuObserver = observer.load(memory_order_acquire);
+  if (apuObserver) {
+    const int16 *stems[CHANNEL_COUNT];
+    for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+      stems[idx] = stemsEnabled ? stemSamples[idx].data() : nullptr;
     }
-  } else {
-    sweepCycles[0] = 0;
-    lengthCycles[0] = 0;
+    apuObserver->samplesCaptured(samples.data(), stems, sampleCount);
   }
 }
 
-void APU::channel2Step() {
-  if (channel2On()) {
-    sweepCycles[1] += cgb->doubleSpeedMode ? 0.5 : 1.0;
-  } else {
-    sweepCycles[1] = 0;
-    lengthCycles[1] = 0;
+// running sum of deltas with a one pole
+// high-pass to remove the dc offset
+void APU::integrate(const float *deltas, uint32 count, float &sum, float &dc,
+                    int16 *out, uint32 stride) {
+  for (uint32 i = 0; i < count; ++i) {
+    sum += deltas[i];
+    float sample = sum - dc;
+    dc += sample * HIGH_PASS_RATE;
+    out[i * stride] = (int16)clamp(sample, -32768.0f, 32767.0f);
   }
 }
 
-void APU::channel3Step() {
-  if (channel3On()) {
-    sweepCycles[2] += cgb->doubleSpeedMode ? 0.5 : 1.0;
-  } else {
-    sweepCycles[2] = 0;
-    lengthCycles[2] = 0;
+// **************************************************
+// **************************************************
+// Register Write Functions
+// **************************************************
+// **************************************************
+
+void APU::write(uint16 addr, uint8 val) {
+  catchUp();
+  uint8 &reg = cgb->mem.getByte(addr);
+
+  // wave ram is always writable
+  if (addr >= WAVE_RAM) {
+    reg = val;
+    return;
+  }
+
+  // only bit 7 of register NR52 can
+  // be written to
+  if (addr == NR52) {
+    bool wasOn = soundOn();
+    reg = (val & BIT7_MASK) | (reg & ~BIT7_MASK);
+    if (wasOn && !soundOn()) powerOff();
+    if (!wasOn && soundOn()) {
+      sequencerStep = 0;
+      channels[3].period = channel4Period();
+    }
+    return;
+  }
+
+  // registers are read-only while powered off
+  if (!soundOn()) return;
+  reg = val;
+
+  switch (addr) {
+    case NR11:
+      channels[0].length = 64 - (val & SIX_BITS_MASK);
+      break;
+    case NR12:
+      setDac(0, val & 0xF8);
+      break;
+    case NR13:
+      channels[0].period = (WAVELENGTH_MAX + 1 - channel1Wavelength()) * 4;
+      break;
+    case NR14:
+      channels[0].period = (WAVELENGTH_MAX + 1 - channel1Wavelength()) * 4;
+      writeControl(0, val);
+      break;
+    case NR21:
+      channels[1].length = 64 - (val & SIX_BITS_MASK);
+      break;
+    case NR22:
+      setDac(1, val & 0xF8);
+      break;
+    case NR23:
+      channels[1].period = (WAVELENGTH_MAX + 1 - channel2Wavelength()) * 4;
+      break;
+    case NR24:
+      channels[1].period = (WAVELENGTH_MAX + 1 - channel2Wavelength()) * 4;
+      writeControl(1, val);
+      break;
+    case NR30:
+      setDac(2, val & BIT7_MASK);
+      break;
+    case NR31:
+      channels[2].length = 256 - val;
+      break;
+    case NR32:
+      updateOutput(2, lastClock);
+      break;
+    case NR33:
+      channels[2].period = (WAVELENGTH_MAX + 1 - channel3Wavelength()) * 2;
+      break;
+    case NR34:
+      channels[2].period = (WAVELENGTH_MAX + 1 - channel3Wavelength()) * 2;
+      writeControl(2, val);
+      break;
+    case NR41:
+      channels[3].length = 64 - (val & SIX_BITS_MASK);
+      break;
+    case NR42:
+      setDac(3, val & 0xF8);
+      break;
+    case NR43:
+      channels[3].period = channel4Period();
+      break;
+    case NR44:
+      writeControl(3, val);
+      break;
+    case NR50:
+    case NR51:
+      for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+        updateOutput(idx, lastClock);
+      }
+      break;
   }
 }
 
-void APU::channel4Step() {
-  if (channel4On()) {
-    sweepCycles[3] += cgb->doubleSpeedMode ? 0.5 : 1.0;
-  } else {
-    sweepCycles[3] = 0;
-    lengthCycles[3] = 0;
+// NRx4 length enable & trigger
+void APU::writeControl(uint8 idx, uint8 val) {
+  channels[idx].lengthEnabled = val & BIT6_MASK;
+  if (val & BIT7_MASK) trigger(idx);
+}
+
+void APU::trigger(uint8 idx) {
+  channel_t &ch = channels[idx];
+  ch.enabled = ch.dacEnabled;
+  if (ch.length == 0) ch.length = idx == 2 ? 256 : 64;
+  ch.timer = ch.period;
+
+  switch (idx) {
+    case 0:
+      loadEnvelope(0, cgb->mem.getByte(NR12));
+      sweepShadow = channel1Wavelength();
+      sweepTimer = channel1SweepPace() ? channel1SweepPace() : 8;
+      sweepEnabled = channel1SweepPace() || channel1SweepSlope();
+      if (channel1SweepSlope()) sweepCalculation();
+      break;
+    case 1:
+      loadEnvelope(1, cgb->mem.getByte(NR22));
+      break;
+    case 2:
+      ch.step = 0;
+      break;
+    case 3:
+      loadEnvelope(3, cgb->mem.getByte(NR42));
+      ch.period = channel4Period();
+      ch.timer = ch.period;
+      lfsr = 0x7FFF;
+      break;
   }
+
+  cgb->mem.getByte(NR52) |= 1 << idx;
+  updateOutput(idx, lastClock);
+}
+
+// NRx2 volume & envelope, loaded on trigger
+void APU::loadEnvelope(uint8 idx, uint8 reg) {
+  channel_t &ch = channels[idx];
+  ch.volume = reg >> 4;
+  ch.envelopeIncrease = reg & BIT3_MASK;
+  ch.envelopePace = reg & THREE_BITS_MASK;
+  ch.envelopeTimer = ch.envelopePace;
+}
+
+// turning the dac off also disables the channel
+void APU::setDac(uint8 idx, bool enabled) {
+  channels[idx].dacEnabled = enabled;
+  if (!enabled) disableChannel(idx);
+  updateOutput(idx, lastClock);
+}
+
+void APU::disableChannel(uint8 idx) {
+  channels[idx].enabled = false;
+  cgb->mem.getByte(NR52) &= ~(1 << idx);
+  updateOutput(idx, lastClock);
+}
+
+// powering off clears all sound registers
+// except wave ram
+void APU::powerOff() {
+  for (uint16 addr = NR10; addr < NR52; ++addr) cgb->mem.getByte(addr) = 0;
+  for (uint8 idx = 0; idx < CHANNEL_COUNT; ++idx) {
+    channels[idx].dacEnabled = false;
+    channels[idx].lengthEnabled = false;
+    channels[idx].length = 0;
+    disableChannel(idx);
+  }
+  sweepEnabled = false;
 }
 
 // **************************************************
@@ -94,14 +578,6 @@ bool APU::channel2On() { return cgb->mem.getByte(NR52) & BIT1_MASK; }
 
 bool APU::channel1On() { return cgb->mem.getByte(NR52) & BIT0_MASK; }
 
-void APU::disableChannel4() { cgb->mem.getByte(NR52) &= ~BIT3_MASK; }
-
-void APU::disableChannel3() { cgb->mem.getByte(NR52) &= ~BIT2_MASK; }
-
-void APU::disableChannel2() { cgb->mem.getByte(NR52) &= ~BIT1_MASK; }
-
-void APU::disableChannel1() { cgb->mem.getByte(NR52) &= ~BIT0_MASK; }
-
 // **************************************************
 // **************************************************
 // NR51 Sound Panning Functions
@@ -153,7 +629,10 @@ uint8 APU::channel1SweepPace() {
   return (cgb->mem.getByte(NR10) >> 4) & THREE_BITS_MASK;
 }
 
-bool APU::channel1IncreaseSweep() { return cgb->mem.getByte(NR10) & BIT3_MASK; }
+// bit 3 set means the wavelength decreases
+bool APU::channel1IncreaseSweep() {
+  return !(cgb->mem.getByte(NR10) & BIT3_MASK);
+}
 
 uint8 APU::channel1SweepSlope() {
   return cgb->mem.getByte(NR10) & THREE_BITS_MASK;
@@ -193,16 +672,7 @@ uint16 APU::channel1Wavelength() {
          cgb->mem.getByte(NR13);
 }
 
-void APU::updateChannel1Wavelength() {
-  // for wavelength L at time t and
-  // sweep slope n:
-  // L{t+1} = L{t} ± (L{t} / (2 ^ n))
-  uint16 wavelength = channel1Wavelength();
-  uint16 wavelengthDiv2n = wavelength / pow(2, channel1SweepSlope());
-  wavelength += channel1IncreaseSweep() ? wavelengthDiv2n : -wavelengthDiv2n;
-  if (wavelength > 0x7FF) disableChannel1();
-
-  // set updated wavelength
+void APU::setChannel1Wavelength(uint16 wavelength) {
   cgb->mem.getByte(NR13) = wavelength & BYTE_MASK;
   cgb->mem.getByte(NR14) &= ~THREE_BITS_MASK;
   cgb->mem.getByte(NR14) |= (wavelength >> 8) & THREE_BITS_MASK;
@@ -257,7 +727,7 @@ uint16 APU::channel2Wavelength() {
 void APU::setChannel2Wavelength(uint16 wavelength) {
   cgb->mem.getByte(NR23) = wavelength & BYTE_MASK;
   cgb->mem.getByte(NR24) &= ~THREE_BITS_MASK;
-  cgb->mem.getByte(NR24) |= wavelength & THREE_BITS_MASK;
+  cgb->mem.getByte(NR24) |= (wavelength >> 8) & THREE_BITS_MASK;
 }
 
 bool APU::triggerChannel2() { return cgb->mem.getByte(NR24) & BIT7_MASK; }
@@ -300,7 +770,7 @@ uint16 APU::channel3Wavelength() {
 void APU::setChannel3Wavelength(uint16 wavelength) {
   cgb->mem.getByte(NR33) = wavelength & BYTE_MASK;
   cgb->mem.getByte(NR34) &= ~THREE_BITS_MASK;
-  cgb->mem.getByte(NR34) |= wavelength & THREE_BITS_MASK;
+  cgb->mem.getByte(NR34) |= (wavelength >> 8) & THREE_BITS_MASK;
 }
 
 bool APU::triggerChannel3() { return cgb->mem.getByte(NR34) & BIT7_MASK; }
@@ -350,6 +820,12 @@ uint8 APU::channel4ClockDivider() {
   return cgb->mem.getByte(NR43) & THREE_BITS_MASK;
 }
 
+// t-cycles between lfsr clocks
+uint32 APU::channel4Period() {
+  uint8 divider = channel4ClockDivider();
+  return (divider ? divider * 16 : 8) << channel4ClockShift();
+}
+
 // **************************************************
 // NR44 Control
 // **************************************************
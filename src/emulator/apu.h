@@ -9,34 +9,143 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 
+#include "spscqueue.h"
 #include "types.h"
 
-#define SWEEP_BASE_TICKS 128
 #define CHANNEL_COUNT 4
-#define CYCLES_PER_TICK 8192
+#define AUDIO_SAMPLE_RATE 48000
+#define FRAME_SEQUENCER_CYCLES 8192  // t-cycles per 512 hz step
+#define WAVELENGTH_MAX 0x7FF
+
+// samples are synthesized a frame at a time, a
+// frame is cut short if it runs past the buffer
+#define APU_BUFFER_SAMPLES 2048
+#define APU_MAX_FRAME_CYCLES 131072
+
+// band-limited step synthesis, each level change
+// is spread over BLIP_TAPS samples using one of
+// BLIP_PHASES windowed sinc kernels
+#define BLIP_TAPS 16
+#define BLIP_PHASES 32
+#define BLIP_PHASE_SHIFT 27  // 32 fractional bits - log2(BLIP_PHASES)
+#define BLIP_CUTOFF 0.9
+#define HIGH_PASS_RATE (1.0f / 2048)
+#define APU_VOLUME_SCALE 64
+
+// interleaved stereo samples queued for the
+// audio device, emulation is paced to keep
+// about AUDIO_TARGET_FRAMES in the ring
+#define AUDIO_RING_SAMPLES 16384
+#define AUDIO_TARGET_FRAMES 2400
 
 using namespace std;
 
 class CGB;
+class StateReader;
+class StateWriter;
+
+typedef struct {
+  bool enabled, dacEnabled, lengthEnabled;
+  uint16 length;
+  uint32 period, timer;  // t-cycles per waveform step
+  uint8 step, output;    // waveform position & value
+  uint8 volume, envelopePace, envelopeTimer;
+  bool envelopeIncrease;
+  int left, right;  // current contribution to mix
+  int level;        // current stem level
+} channel_t;
+
+// capture observer notified on the emulation thread
+// with the samples of each finished frame, stems hold
+// one mono buffer per channel if they were requested
+class APUObserver {
+ public:
+  virtual ~APUObserver() {}
+  virtual void samplesCaptured(const int16 *mix, const int16 *const *stems,
+                               uint32 count) = 0;
+};
 
 class APU {
  private:
-  array<float, CHANNEL_COUNT> sweepCycles;
-  array<float, CHANNEL_COUNT> lengthCycles;
-
-  uint16 channel1CurrSweepPace;
+  static const uint8 dutyWaveforms[4];
+  static const uint8 waveShifts[4];
+
+  array<channel_t, CHANNEL_COUNT> channels;
+  uint8 sweepTimer;
+  uint16 sweepShadow;
+  bool sweepEnabled;
+  uint16 lfsr;
+  uint8 sequencerStep;
+
+  // lastClock is how far synthesis has caught up,
+  // sample positions are 32.32 fixed point
+  uint64 lastClock, nextSequencerClock, frameStartClock;
+  uint64 framePhase, sampleStep;
+
+  array<array<float, BLIP_TAPS>, BLIP_PHASES> kernel;
+  typedef array<float, APU_BUFFER_SAMPLES + BLIP_TAPS> delta_buffer_t;
+  delta_buffer_t deltasLeft, deltasRight;
+  float sumLeft, sumRight, dcLeft, dcRight;
+  array<int16, APU_BUFFER_SAMPLES * 2> samples;
+  uint32 sampleCount;
+
+  // per channel mono output, only synthesized
+  // while an observer asks for stems
+  array<delta_buffer_t, CHANNEL_COUNT> stemDeltas;
+  array<float, CHANNEL_COUNT> stemSums, stemDcs;
+  array<array<int16, APU_BUFFER_SAMPLES>, CHANNEL_COUNT> stemSamples;
+  bool stemsEnabled;
+  atomic<APUObserver *> observer;
+
+  void buildKernel();
+  void run(uint64 target);
+  void runChannel(uint8 idx, uint64 end);
+  void finishFrame();
+  void stepSequencer();
+  void addDelta(uint64 time, int left, int right);
+  void addStemDelta(uint8 idx, uint64 time, int delta);
+  static void integrate(const float *deltas, uint32 count, float &sum,
+                        float &dc, int16 *out, uint32 stride);
+  void updateOutput(uint8 idx, uint64 time);
+  uint8 amplitude(uint8 idx);
+
+  void trigger(uint8 idx);
+  void writeControl(uint8 idx, uint8 val);
+  void setDac(uint8 idx, bool enabled);
+  void disableChannel(uint8 idx);
+  void loadEnvelope(uint8 idx, uint8 reg);
+  uint16 sweepCalculation();
+  void powerOff();
 
  public:
   APU();
   CGB *cgb;
 
-  void step();
+  // written by the emulation thread, read by
+  // the audio device, audioSync is set while
+  // the device is playing from the ring
+  SpscQueue<int16, AUDIO_RING_SAMPLES> ring;
+  atomic<bool> audioSync;
+
+  // muted frames are synthesized but their
+  // samples are neither played nor captured
+  bool muted;
+
+  void reset();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+  void write(uint16 addr, uint8 val);
+  void catchUp();
+  void endFrame();
+
+  // interleaved stereo samples from the last frame
+  const int16 *frameSamples() const;
+  uint32 frameSampleCount() const;
 
-  void channel1Step();
-  void channel2Step();
-  void channel3Step();
-  void channel4Step();
+  void attachObserver(APUObserver *apuObserver, bool stems);
+  void detachObserver();
 
   // NR52 sound on/off functions
   bool soundOn();
@@ -44,10 +153,6 @@ class APU {
   bool channel3On();
   bool channel2On();
   bool channel1On();
-  void disableChannel4();
-  void disableChannel3();
-  void disableChannel2();
-  void disableChannel1();
 
   // NR51 sound panning functions
   bool mixChannel4Left();
@@ -81,7 +186,7 @@ class APU {
 
   // NR13 + NR14 channel 1 wavelength & control
   uint16 channel1Wavelength();
-  void updateChannel1Wavelength();
+  void setChannel1Wavelength(uint16 wavelength);
   bool triggerChannel1();
   bool channel1SoundLengthEnabled();
 
@@ -94,7 +199,7 @@ class APU {
   bool channel2IncreaseEnvelope();
   uint8 channel2EnvelopeSweepPace();
 
-  // NR23 + NR14 channel 2 wavelength & control
+  // NR23 + NR24 channel 2 wavelength & control
   uint16 channel2Wavelength();
   void setChannel2Wavelength(uint16 wavelength);
   bool triggerChannel2();
@@ -127,6 +232,7 @@ class APU {
   uint8 channel4ClockShift();
   bool lfsrWidth();
   uint8 channel4ClockDivider();
+  uint32 channel4Period();
 
   // NR44 channel 4 control
   bool triggerChannel4();
@@ -0,0 +1,115 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Audio Writer (Background WAV / Raw PCM Writer)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "audiowriter.h"
+
+using namespace chrono;
+
+AudioWriter::AudioWriter()
+    : file(),
+      format(WAV_FILE),
+      channels(0),
+      sampleRate(0),
+      dataBytes(0),
+      queue(),
+      chunk(),
+      writerThread(),
+      running(false) {}
+
+AudioWriter::~AudioWriter() { close(); }
+
+bool AudioWriter::open(const QString &path, AudioFileFormat format,
+                       uint16 channels, uint32 sampleRate) {
+  close();
+  file.setFileName(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+  this->format = format;
+  this->channels = channels;
+  this->sampleRate = sampleRate;
+  dataBytes = 0;
+  if (format == WAV_FILE) writeHeader();
+
+  running = true;
+  writerThread = thread(&AudioWriter::writeLoop, this);
+  return true;
+}
+
+// queue samples for the writer thread, waits
+// for the writer if the queue is full so no
+// sample is ever dropped
+void AudioWriter::write(const int16 *samples, size_t count) {
+  while (count > 0) {
+    size_t written = queue.write(samples, count);
+    samples += written;
+    count -= written;
+    if (count > 0) {
+      wake.notify_one();
+      this_thread::yield();
+    }
+  }
+  wake.notify_one();
+}
+
+// write remaining samples and finish the file
+void AudioWriter::close() {
+  if (!writerThread.joinable()) return;
+  running = false;
+  wake.notify_one();
+  writerThread.join();
+
+  if (format == WAV_FILE) {
+    file.seek(0);
+    writeHeader();
+  }
+  file.close();
+}
+
+// writer thread loop, sleeps while the queue is
+// empty and drains it before exiting
+void AudioWriter::writeLoop() {
+  while (true) {
+    size_t count = queue.read(chunk.data(), chunk.size());
+    if (count > 0) {
+      file.write((const char *)chunk.data(), count * sizeof(int16));
+      dataBytes += count * sizeof(int16);
+      continue;
+    }
+    if (!running) break;
+
+    unique_lock<mutex> lock(wakeMutex);
+    wake.wait_for(lock, milliseconds(1));
+  }
+}
+
+// canonical 44 byte pcm wav header
+void AudioWriter::writeHeader() {
+  uint8 header[WAV_HEADER_BYTES];
+  auto put = [&header](int offset, uint32 val, int bytes) {
+    for (int i = 0; i < bytes; ++i) header[offset + i] = val >> (i * 8);
+  };
+  auto tag = [&header](int offset, const char *name) {
+    for (int i = 0; i < 4; ++i) header[offset + i] = name[i];
+  };
+
+  uint32 blockAlign = channels * sizeof(int16);
+  tag(0, "RIFF");
+  put(4, WAV_HEADER_BYTES - 8 + dataBytes, 4);
+  tag(8, "WAVE");
+  tag(12, "fmt ");
+  put(16, 16, 4);
+  put(20, 1, 2);
+  put(22, channels, 2);
+  put(24, sampleRate, 4);
+  put(28, sampleRate * blockAlign, 4);
+  put(32, blockAlign, 2);
+  put(34, 16, 2);
+  tag(36, "data");
+  put(40, dataBytes, 4);
+  file.write((const char *)header, WAV_HEADER_BYTES);
+}
@@ -0,0 +1,61 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Audio Writer (Background WAV / Raw PCM Writer)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <QFile>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "spscqueue.h"
+#include "types.h"
+
+// about five seconds of stereo samples can be
+// queued before the emulation thread has to wait
+#define AUDIO_WRITER_SAMPLES 0x80000
+#define AUDIO_WRITER_CHUNK 0x4000
+#define WAV_HEADER_BYTES 44
+
+using namespace std;
+
+enum AudioFileFormat : uint8 { WAV_FILE, RAW_FILE };
+
+// writes 16-bit pcm samples to a file on its own
+// thread, wav headers are written with placeholder
+// sizes that are filled in when the file is closed
+class AudioWriter {
+ private:
+  QFile file;
+  AudioFileFormat format;
+  uint16 channels;
+  uint32 sampleRate;
+  uint64 dataBytes;
+
+  SpscQueue<int16, AUDIO_WRITER_SAMPLES> queue;
+  array<int16, AUDIO_WRITER_CHUNK> chunk;
+  thread writerThread;
+  atomic<bool> running;
+  mutex wakeMutex;
+  condition_variable wake;
+
+  void writeLoop();
+  void writeHeader();
+
+ public:
+  AudioWriter();
+  ~AudioWriter();
+
+  bool open(const QString &path, AudioFileFormat format, uint16 channels,
+            uint32 sampleRate);
+  void write(const int16 *samples, size_t count);
+  void close();
+};
@@ -11,6 +11,10 @@
 #include <QCoreApplication>
 #include <QFile>
 
+#include "cgb.h"
+#include "log.h"
+#include "savestate.h"
+
 // dmg bootstrap bytes (256 bytes)
 uint8 Bootstrap::dmgBootstrap[DMG_BOOTSTRAP_BYTES]{
     0x31, 0xFE, 0xFF, 0xAF, 0x21, 0xFF, 0x9F, 0x32, 0xCB, 0x7C, 0x20, 0xFB,
@@ -231,7 +235,12 @@ uint8 Bootstrap::cgbBootstrap[CGB_BOOTSTRAP_BYTES]{
     0x21, 0x22, 0x80, 0x81, 0x82, 0x10, 0x11, 0x12, 0x12, 0xB0, 0x79, 0xB8,
     0xAD, 0x16, 0x17, 0x07, 0xBA, 0x05, 0x7C, 0x13, 0x00, 0x00, 0x00, 0x00};
 
-Bootstrap::Bootstrap() : enabled(true), skipDmg(false), cgbMode(nullptr) {}
+Bootstrap::Bootstrap()
+    : cgb(nullptr),
+      enabled(true),
+      skipDmg(false),
+      fastBoot(false),
+      cgbMode(nullptr) {}
 
 // get byte of bootstrap at given address
 uint8 *Bootstrap::at(uint16 addr) const {
@@ -246,3 +255,159 @@ bool Bootstrap::skipDmgBootstrap() const {
 
 // reset bootstrap
 void Bootstrap::reset() { enabled = true; }
+
+// save whether the bootstrap is still mapped
+void Bootstrap::saveState(StateWriter &state) const {
+  state.beginSection(BOOTSTRAP_SECTION);
+  state.write(enabled);
+  state.endSection();
+}
+
+void Bootstrap::loadState(StateReader &state) { state.read(enabled); }
+
+// **************************************************
+// **************************************************
+// Fast Boot Functions
+// **************************************************
+// **************************************************
+
+// leave the cpu, io registers, vram and cram as
+// the bootstrap leaves them when it jumps to the
+// cartridge at 0100, without running it
+void Bootstrap::boot() {
+  enabled = false;
+  Log::bootstrap = false;
+
+  // same check as the bootstrap makes when
+  // it unmaps itself
+  if (*cgbMode) {
+    uint8 cgbFlag = cgb->mem.cart[CGB_MODE];
+    cgb->dmgMode = !(cgbFlag == 0x80 || cgbFlag == 0xC0);
+  }
+
+  bootCpu();
+  bootIo();
+  bootLogo();
+  if (*cgbMode) bootCram();
+}
+
+void Bootstrap::bootCpu() {
+  CPU &cpu = cgb->cpu;
+  const uint8 *cart = cgb->mem.cart;
+
+  // half carry and carry are only clear if
+  // the header checksum is zero
+  if (!*cgbMode) {
+    uint16 AF = cart[HEADER_CHECKSUM] != 0 ? 0x01B0 : 0x0180;
+    cpu.setRegisters(AF, 0x0013, 0x00D8, 0x014D, BOOT_SP, BOOT_PC);
+    return;
+  }
+  if (!cgb->dmgMode) {
+    cpu.setRegisters(0x1180, 0x0000, 0xFF56, 0x000D, BOOT_SP, BOOT_PC);
+    return;
+  }
+
+  // b holds the title checksum the bootstrap
+  // uses to look up palettes for games
+  // licensed by nintendo
+  bool nintendo =
+      cart[OLD_LICENSEE] == 0x01 ||
+      (cart[OLD_LICENSEE] == 0x33 && cart[NEW_LICENSEE] == '0' &&
+       cart[NEW_LICENSEE + 1] == '1');
+  uint8 titleChecksum = 0;
+  for (int idx = 0; nintendo && idx < TITLE_BYTES; ++idx) {
+    titleChecksum += cart[TITLE + idx];
+  }
+  cpu.setRegisters(0x1180, titleChecksum << 8, 0x0008, 0x007C, BOOT_SP,
+                   BOOT_PC);
+}
+
+// only registers the bootstrap leaves changed are
+// set, sound registers are written through the apu
+// except the channel 1 frequency, since writing it
+// would trigger the boot sound
+void Bootstrap::bootIo() {
+  Memory &mem = cgb->mem;
+  cgb->timers.internalCounter =
+      *cgbMode ? CGB_BOOT_DIV_COUNTER : DMG_BOOT_DIV_COUNTER;
+  mem.getByte(DIV) = cgb->timers.internalCounter >> 8;
+  mem.getByte(P1) = 0xCF;
+  mem.getByte(IF) = *cgbMode ? 0xE1 : VBLANK_INT;
+  mem.getByte(LCDC) = 0x91;
+  mem.getByte(BGP) = 0xFC;
+  mem.getByte(BOOTSTRAP) = *cgbMode ? 0x11 : 0x01;
+
+  cgb->apu.write(NR52, 0x80);
+  cgb->apu.write(NR11, 0x80);
+  cgb->apu.write(NR12, 0xF3);
+  cgb->apu.write(NR50, 0x77);
+  cgb->apu.write(NR51, 0xF3);
+  mem.getByte(NR13) = 0xC1;
+  mem.getByte(NR14) = 0x87;
+
+  if (*cgbMode) {
+    for (uint16 addr = WAVE_RAM; addr < WAVE_RAM_END; addr += 2) {
+      cgb->apu.write(addr + 1, 0xFF);
+    }
+    mem.getByte(KEY0) = cgb->dmgMode ? 0x04 : 0x80;
+    mem.getByte(HDMA5) = 0xFF;
+    mem.getByte(OPRI) = cgb->dmgMode ? 0x01 : 0x00;
+  }
+}
+
+// the logo in the cartridge header is stored one
+// bit per 2x2 pixels, each nibble becomes two rows
+// of a tile with every bit doubled, followed by
+// the registered mark from the dmg bootstrap
+void Bootstrap::bootLogo() {
+  Memory &mem = cgb->mem;
+  uint16 addr = LOGO_TILES_ADDR;
+  for (int idx = 0; idx < LOGO_BYTES; ++idx) {
+    uint8 logoByte = mem.cart[LOGO + idx];
+    for (int shift = 4; shift >= 0; shift -= 4) {
+      uint8 row = 0;
+      for (int bit = 0; bit < 4; ++bit) {
+        if (logoByte >> shift & (1 << bit)) row |= 0b11 << (bit * 2);
+      }
+      for (int copy = 0; copy < 2; ++copy, addr += 2) {
+        mem.getVramByte(addr, false) = row;
+      }
+    }
+  }
+  for (int row = 0; row < TILE_ROWS; ++row) {
+    mem.getVramByte(REGISTERED_TILE_ADDR + row * 2, false) =
+        dmgBootstrap[REGISTERED_BOOTSTRAP_ADDR + row];
+  }
+
+  // the cgb bootstrap clears the tile map
+  if (*cgbMode) return;
+  mem.getVramByte(REGISTERED_MAP_ADDR, false) = REGISTERED_TILE;
+  for (int tile = 1; tile <= LOGO_TILES_PER_ROW; ++tile) {
+    mem.getVramByte(LOGO_MAP_ROW1_ADDR + tile - 1, false) = tile;
+    mem.getVramByte(LOGO_MAP_ROW2_ADDR + tile - 1, false) =
+        tile + LOGO_TILES_PER_ROW;
+  }
+}
+
+// cgb games start with white background palettes,
+// dmg games get grayscale background and object
+// palettes since the palettes the bootstrap picks
+// by title checksum are not applied
+void Bootstrap::bootCram() {
+  Memory &mem = cgb->mem;
+  if (!cgb->dmgMode) {
+    for (int idx = 0; idx < PAL_COUNT * PAL_BYTES; idx += 2) {
+      mem.cramBg[idx] = 0xFF;
+      mem.cramBg[idx + 1] = 0x7F;
+    }
+    return;
+  }
+
+  const uint16 grays[4]{0x7FFF, 0x56B5, 0x294A, 0x0000};
+  for (int color = 0; color < 4; ++color) {
+    for (uint8 *cram : {mem.cramBg, mem.cramObj, mem.cramObj + PAL_BYTES}) {
+      cram[color * 2] = grays[color];
+      cram[color * 2 + 1] = grays[color] >> 8;
+    }
+  }
+}
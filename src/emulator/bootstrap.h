@@ -14,17 +14,46 @@
 #define CGB_BOOTSTRAP_BYTES 0x900
 #define CGB_BOOTSTRAP_PART2_ADDR 0x200
 
+// state left by the bootstrap, see boot()
+#define BOOT_PC 0x0100
+#define BOOT_SP 0xFFFE
+#define DMG_BOOT_DIV_COUNTER 0xABCC
+#define CGB_BOOT_DIV_COUNTER 0x1EA0
+#define LOGO_TILES_ADDR 0x8010
+#define LOGO_MAP_ROW1_ADDR 0x9904
+#define LOGO_MAP_ROW2_ADDR 0x9924
+#define LOGO_TILES_PER_ROW 12
+#define REGISTERED_TILE 0x19
+#define REGISTERED_TILE_ADDR 0x8190
+#define REGISTERED_MAP_ADDR 0x9910
+#define REGISTERED_BOOTSTRAP_ADDR 0xD8
+#define TILE_ROWS 8
+
+class CGB;
+class StateReader;
+class StateWriter;
+
 class Bootstrap {
  private:
   static uint8 dmgBootstrap[DMG_BOOTSTRAP_BYTES];
   static uint8 cgbBootstrap[CGB_BOOTSTRAP_BYTES];
 
+  // fast boot functions
+  void bootCpu();
+  void bootIo();
+  void bootLogo();
+  void bootCram();
+
  public:
-  bool enabled, skipDmg, *cgbMode;
+  CGB *cgb;
+  bool enabled, skipDmg, fastBoot, *cgbMode;
 
   Bootstrap();
 
   uint8 *at(uint16 addr) const;
   bool skipDmgBootstrap() const;
   void reset();
+  void boot();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
@@ -11,7 +11,8 @@
 #include <math.h>
 
 #include <QDir>
-#include <QMessageBox>
+#include <QFile>
+#include <QFileInfo>
 
 #include "../ui/settings.h"
 #include "bootstrap.h"
@@ -35,16 +36,27 @@ CGB::CGB()
       apu(),
       timers(),
       rtc(),
+      rewind(),
+      movie(),
+      frameBuffer(SCREEN_PX_WIDTH, SCREEN_PX_HEIGHT),
       romPath(QDir::currentPath()),
+      actionPause(nullptr),
       stop(false),
       cgbMode(true),
       dmgMode(false),
       doubleSpeedMode(false),
-      screen(SCREEN_PX_WIDTH, SCREEN_PX_HEIGHT, QImage::Format_RGB32),
-      actionPause(nullptr),
+      masterClock(0),
+      cyclesPerStep(T_CYCLES_PER_STEP),
+      frameNumber(0),
       running(false),
       pause(false),
-      tempPalette(nullptr) {
+      behindRealTime(false),
+      rewinding(false),
+      tempPalette(nullptr),
+      persistSaves(true),
+      runAheadFrames(0),
+      runAheadState(),
+      scratchState() {
   // cgb pointers
   cpu.cgb = this;
   mem.cgb = this;
@@ -53,8 +65,11 @@ CGB::CGB()
   controls.cgb = this;
   timers.cgb = this;
   rtc.cgb = this;
+  rewind.cgb = this;
+  movie.cgb = this;
 
   // bootstrap
+  bootstrap.cgb = this;
   bootstrap.cgbMode = &cgbMode;
 
   // mbc
@@ -62,7 +77,7 @@ CGB::CGB()
   mbc.rtc = &rtc;
 
   // ppu
-  ppu.screen = &screen;
+  ppu.frameBuffer = &frameBuffer;
   ppu.palette = Palettes::allPalettes[DEFAULT_PALETTE_IDX];
 }
 
@@ -71,9 +86,9 @@ CGB::~CGB() {
   wait();
 
   save();
+  ppu.flushRenderer();
 
   std::free(mem.mem);
-  std::free(mem.cart);
   std::free(mem.vram);
   std::free(mem.exram);
   std::free(mem.wram);
@@ -81,30 +96,115 @@ CGB::~CGB() {
 
 void CGB::run() {
   running = true;
-  auto clock = high_resolution_clock::now();
-  while (running) {
-    if (!pause) {
-      cpu.step();
 
-      uint8 cycles = cpu.cpuCycles;
-      if (stop) {
-        ppu.step();
-        cycles = doubleSpeedMode ? 2 : 1;
+  // real time is derived from the master clock
+  // relative to an anchor so rounding never
+  // accumulates, the anchor moves whenever
+  // emulation is not throttled by the clock
+  auto anchorTime = high_resolution_clock::now();
+  uint64 anchorClock = masterClock;
+  bool anchored = true;
+  uint64 realFrame = frameNumber;
+  while (running) {
+    if (rewinding && !pause && movie.mode == MOVIE_OFF) {
+      // show one frame after each step back,
+      // even if real frames are hidden
+      anchored = false;
+      behindRealTime = false;
+      if (rewind.stepBack()) {
+        ppu.hideFrames = false;
+        runFrame();
+        ppu.hideFrames = runAheadFrames > 0;
+      }
+      long long frameDuration = FRAME_DURATION;
+      this_thread::sleep_for(microseconds(frameDuration));
+    } else if (!pause) {
+      step();
+      rewind.update();
+      if (frameNumber != realFrame) {
+        realFrame = frameNumber;
+        movie.nextFrame();
+        if (runAheadFrames > 0) runAhead();
       }
 
-      if (!bootstrap.skipDmgBootstrap()) {
-        int duration = (NS_PER_CYCLE * cycles) / (doubleSpeedMode ? 2 : 1);
-        clock += nanoseconds(duration);
-        this_thread::sleep_until(clock);
+      if (bootstrap.skipDmgBootstrap()) {
+        anchored = false;
+        behindRealTime = false;
+      } else if (apu.audioSync) {
+        anchored = false;
+        syncToAudio();
       } else {
-        clock = high_resolution_clock::now();
+        if (!anchored) {
+          anchorTime = high_resolution_clock::now();
+          anchorClock = masterClock;
+          anchored = true;
+        }
+        uint64 elapsed = masterClock - anchorClock;
+        auto clock = anchorTime + seconds(elapsed / T_CYCLES_PER_SEC) +
+                     nanoseconds((elapsed % T_CYCLES_PER_SEC) *
+                                 (long long)NS_PER_SEC / T_CYCLES_PER_SEC);
+        long long frameDuration = FRAME_DURATION;
+        auto lag = high_resolution_clock::now() - clock;
+        behindRealTime = lag > microseconds(frameDuration);
+        this_thread::sleep_until(clock);
       }
     } else {
-      clock = high_resolution_clock::now();
+      anchored = false;
+      behindRealTime = false;
+      this_thread::sleep_for(milliseconds(1));
     }
   }
 }
 
+// emulate ahead of the frame that just ended
+// with the current input and show the last frame
+// emulated, then go back, so the screen shows
+// what the game will draw a few frames from now,
+// real frames are hidden and ahead frames muted
+void CGB::runAhead() {
+  snapshot(runAheadState);
+  apu.muted = true;
+  for (uint8 frame = 1; frame <= runAheadFrames; ++frame) {
+    ppu.hideFrames = frame < runAheadFrames;
+    runFrame();
+  }
+  restore(runAheadState);
+  apu.muted = false;
+  ppu.hideFrames = runAheadFrames > 0;
+}
+
+// execute one instruction, or one machine
+// cycle of the ppu while the cpu is stopped
+void CGB::step() {
+  cpu.step();
+
+  if (stop) {
+    advanceClock();
+    ppu.step();
+  }
+}
+
+// run until the ppu completes a frame, used to
+// drive emulation without starting the thread
+void CGB::runFrame() {
+  uint64 frame = frameNumber;
+  while (frameNumber == frame) step();
+}
+
+// pace emulation by the audio device, the apu
+// queues samples once per frame so this only
+// sleeps after a frame once the ring holds
+// more than the target latency
+void CGB::syncToAudio() {
+  size_t queued = apu.ring.size() / 2;
+  behindRealTime = queued < AUDIO_TARGET_FRAMES / 2;
+  if (queued > AUDIO_TARGET_FRAMES) {
+    this_thread::sleep_for(microseconds((queued - AUDIO_TARGET_FRAMES) *
+                                        (long long)US_PER_SEC /
+                                        AUDIO_SAMPLE_RATE));
+  }
+}
+
 bool CGB::loadRom(const QString romPath) {
   mem.loadRom(romPath);
 
@@ -115,6 +215,9 @@ bool CGB::loadRom(const QString romPath) {
   mbc.halfRAMMode = mbc.bankType == MBC2 || mbc.bankType == MBC2_BATTERY;
   dmgMode = !cgbMode;
 
+  // boot again now the cartridge header is loaded
+  if (bootstrap.fastBoot) bootstrap.boot();
+
   // print rom config
   printf("\n>>> Loaded ROM: %s <<<\n", romPath.toStdString().c_str());
   printf("Bank Type: %s (%02X)\n", mbc.bankTypeStr().c_str(), mbc.bankType);
@@ -125,17 +228,15 @@ bool CGB::loadRom(const QString romPath) {
   printf("RAM Size: %d KiB\n", mbc.ramBytes());
 
   // check if mbc type of cartridge
-  // is implemented
-  if (!mbc.bankTypeImplemented()) {
-    QMessageBox mbox{};
-    auto message = "Bank type " + mbc.bankTypeStr() + " is not supported";
-    mbox.setText(QString::fromStdString(message));
-    mbox.exec();
-    return false;
-  }
+  // is implemented, the caller reports
+  // unsupported cartridges
+  if (!mbc.bankTypeImplemented()) return false;
 
-  // set rom path and load exram and timer
+  // set rom path and load exram and timer,
+  // saves are used again after a movie
   this->romPath = romPath;
+  movie.stop();
+  persistSaves = true;
   load();
 
   return true;
@@ -149,20 +250,26 @@ void CGB::reset(bool newGame) {
   wait();
 
   save();
+  ppu.syncDeferredRendering();
+  ppu.flushRenderer();
 
   // reset flags
   stop = false;
   pause = false;
-  doubleSpeedMode = false;
+  setDoubleSpeedMode(false);
   dmgMode = !cgbMode;
-  actionPause->setChecked(false);
+  if (actionPause != nullptr) actionPause->setChecked(false);
 
   // reset components
   cpu.reset();
   timers.reset();
   mem.reset();
+  ppu.reset();
+  apu.reset();
   mbc.reset();
   bootstrap.reset();
+  if (bootstrap.fastBoot) bootstrap.boot();
+  rewind.clear();
 
   // load external ram if not loading a new game
   // and current game has external ram and
@@ -179,12 +286,42 @@ void CGB::setDevice(bool cgb) {
 }
 
 // toggle whether boot screen should appear
-// before a game is started
+// before a game is started, a running movie
+// keeps the setting it was recorded with
 void CGB::toggleDmgBootstrap(bool skip) {
-  bootstrap.skipDmg = skip;
+  if (movie.mode == MOVIE_OFF) {
+    bootstrap.skipDmg = skip;
+  } else {
+    movie.userSkipDmg = skip;
+  }
   Settings::saveSkipDmgBootstrap(skip);
 }
 
+// toggle whether the bootstrap is skipped by
+// setting up its end state directly, applies
+// from the next reset
+void CGB::toggleFastBoot(bool fast) {
+  bootstrap.fastBoot = fast;
+  Settings::saveFastBoot(fast);
+}
+
+// set number of frames to run ahead, zero
+// turns run ahead off
+void CGB::setRunAhead(int frames) {
+  runAheadFrames = frames;
+  ppu.hideFrames = frames > 0;
+  Settings::saveRunAhead(frames);
+}
+
+// set number of frames to skip between
+// rendered frames, or skip automatically
+// when emulation falls behind real time
+void CGB::setFrameSkip(int frames) {
+  ppu.autoFrameSkip = frames == AUTO_FRAME_SKIP;
+  ppu.frameSkip = ppu.autoFrameSkip ? 0 : frames;
+  Settings::saveFrameSkip(frames);
+}
+
 // save current palette and preview
 // the specified palette
 void CGB::previewPalette(Palette *palette) {
@@ -203,23 +340,36 @@ void CGB::resetPreviewPalette() {
   renderInPauseMode();
 }
 
-// render screen while in pause mode
+// recolor the presented frame with the current
+// palette while in pause mode, the ppu is not
+// stepped so emulation state is left untouched
 void CGB::renderInPauseMode() {
   if (pause) {
-    ppu.cycles = 0;
-    for (int i = 0; i < SCANLINE_CYCLES * SCREEN_LINES; ++i) {
-      ppu.step();
-    }
-    ppu.frameRendered = false;
-    emit sendScreen(&screen);
+    frameBuffer.acquire();
+    ppu.recolorFrame(frameBuffer.front(), frameBuffer.frontColors());
+    frameBuffer.rehashFront();
+    emit sendScreen();
   }
 }
 
+// switch cpu speed, a machine cycle
+// takes half as many t-cycles in double
+// speed mode
+void CGB::setDoubleSpeedMode(bool enabled) {
+  doubleSpeedMode = enabled;
+  cyclesPerStep =
+      enabled ? T_CYCLES_PER_STEP_DOUBLE_SPEED : T_CYCLES_PER_STEP;
+}
+
+// advance master clock by one cpu machine cycle
+void CGB::advanceClock() { masterClock += cyclesPerStep; }
+
 // toggle pause mode
 void CGB::togglePause(bool shouldPause) { pause = shouldPause; }
 
 // restart game boy (reset and start)
 void CGB::restart() {
+  movie.stop();
   reset(false);
   if (romPath != QDir::currentPath()) {
     start(QThread::HighestPriority);
@@ -228,12 +378,246 @@ void CGB::restart() {
 
 // save external ram and real-time clock
 void CGB::save() {
+  if (!persistSaves) return;
   if (mbc.hasRamAndBattery()) mem.saveExram();
   if (mbc.hasTimerAndBattery()) rtc.save();
 }
 
 // load external ram and real-time clock
 void CGB::load() {
+  if (!persistSaves) return;
   if (mbc.hasRamAndBattery()) mem.loadExram();
   if (mbc.hasTimerAndBattery()) rtc.load();
 }
+
+// **************************************************
+// **************************************************
+// Save State Functions
+// **************************************************
+// **************************************************
+
+// global checksum from the cartridge header, read
+// from the cartridge directly since bank 0 may be
+// remapped by the mbc
+uint16 CGB::romChecksum() const {
+  return mem.cart[GLOBAL_CHECKSUM] << 8 | mem.cart[GLOBAL_CHECKSUM + 1];
+}
+
+// save the state of every component, pending
+// rendering and audio are finished first so the
+// state is taken at a single point in time, a
+// buffer reused for snapshots is not reallocated
+void CGB::snapshot(vector<uint8> &buffer) {
+  ppu.syncDeferredRendering();
+  ppu.flushRenderer();
+  apu.catchUp();
+
+  StateWriter state(buffer);
+  state.beginSection(CGB_SECTION);
+  state.write(romChecksum());
+  state.write(cgbMode);
+  state.write(dmgMode);
+  state.write(stop);
+  state.write(doubleSpeedMode);
+  state.write(masterClock);
+  state.write(frameNumber);
+  state.endSection();
+
+  cpu.saveState(state);
+  mem.saveState(state);
+  mbc.saveState(state);
+  rtc.saveState(state);
+  timers.saveState(state);
+  ppu.saveState(state);
+  apu.saveState(state);
+  bootstrap.saveState(state);
+}
+
+// load a state saved by the same rom on the same
+// device, the current state is restored if any
+// section of the loaded state is corrupt
+bool CGB::loadState(const vector<uint8> &buffer) {
+  snapshot(scratchState);
+  if (restore(buffer)) return true;
+  restore(scratchState);
+  return false;
+}
+
+// restore a snapshot without keeping the current
+// state, the state is only partly applied if a
+// section is corrupt so untrusted states should
+// go through loadState
+bool CGB::restore(const vector<uint8> &buffer) {
+  ppu.syncDeferredRendering();
+  ppu.flushRenderer();
+  StateReader state(buffer.data(), buffer.size());
+  if (!state.validate({CGB_SECTION, CPU_SECTION, MEMORY_SECTION, MBC_SECTION,
+                       RTC_SECTION, TIMERS_SECTION, PPU_SECTION, APU_SECTION,
+                       BOOTSTRAP_SECTION})) {
+    return false;
+  }
+
+  // the cgb section comes first and is checked
+  // before any component is changed
+  uint32 tag = 0;
+  uint16 checksum = 0;
+  bool stateCgbMode = false, stateDoubleSpeedMode = false;
+  if (!state.nextSection(tag) || tag != CGB_SECTION) return false;
+  state.read(checksum);
+  state.read(stateCgbMode);
+  if (!state.ok() || checksum != romChecksum() || stateCgbMode != cgbMode) {
+    return false;
+  }
+  state.read(dmgMode);
+  state.read(stop);
+  state.read(stateDoubleSpeedMode);
+  state.read(masterClock);
+  state.read(frameNumber);
+  setDoubleSpeedMode(stateDoubleSpeedMode);
+
+  while (state.nextSection(tag)) {
+    switch (tag) {
+      case CPU_SECTION:
+        cpu.loadState(state);
+        break;
+      case MEMORY_SECTION:
+        mem.loadState(state);
+        break;
+      case MBC_SECTION:
+        mbc.loadState(state);
+        break;
+      case RTC_SECTION:
+        rtc.loadState(state);
+        break;
+      case TIMERS_SECTION:
+        timers.loadState(state);
+        break;
+      case PPU_SECTION:
+        ppu.loadState(state);
+        break;
+      case APU_SECTION:
+        apu.loadState(state);
+        break;
+      case BOOTSTRAP_SECTION:
+        bootstrap.loadState(state);
+        break;
+    }
+    if (!state.ok()) return false;
+  }
+  return true;
+}
+
+// create an independent emulator in the current
+// state sharing the rom image, must not be called
+// while the emulation thread is running
+unique_ptr<CGB> CGB::clone() {
+  auto copy = make_unique<CGB>();
+  copy->persistSaves = false;
+  copy->cgbMode = cgbMode;
+  copy->romPath = romPath;
+  copy->bootstrap.skipDmg = bootstrap.skipDmg;
+  copy->bootstrap.fastBoot = bootstrap.fastBoot;
+  copy->mem.shareCart(mem);
+  copy->mbc.bankType = mbc.bankType;
+  copy->mbc.romSize = mbc.romSize;
+  copy->mbc.ramSize = mbc.ramSize;
+  copy->mbc.halfRAMMode = mbc.halfRAMMode;
+  copy->ppu.palette = ppu.palette;
+  copy->ppu.colorTable = ppu.colorTable;
+  copy->ppu.frameSkip = ppu.frameSkip;
+  copy->ppu.autoFrameSkip = ppu.autoFrameSkip;
+
+  snapshot(scratchState);
+  copy->restore(scratchState);
+  return copy;
+}
+
+// state file has the same name and directory
+// as the rom with a .state extension
+QString CGB::statePath() const {
+  QFileInfo romInfo(romPath);
+  return romInfo.path() + "/" + romInfo.completeBaseName() + STATE_EXTENSION;
+}
+
+// save state to file, the emulation thread is
+// stopped while the state is taken
+bool CGB::saveStateFile() {
+  if (romPath == QDir::currentPath()) return false;
+  bool wasRunning = isRunning();
+  running = false;
+  wait();
+
+  vector<uint8> buffer;
+  snapshot(buffer);
+  QFile stateFile(statePath());
+  bool saved = stateFile.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+               stateFile.write((const char *)buffer.data(), buffer.size()) ==
+                   (qint64)buffer.size();
+  stateFile.close();
+
+  if (wasRunning) start(QThread::HighestPriority);
+  return saved;
+}
+
+// load state from file, the current state is
+// kept if the file is missing or invalid
+bool CGB::loadStateFile() {
+  if (romPath == QDir::currentPath()) return false;
+  QFile stateFile(statePath());
+  if (!stateFile.open(QIODevice::ReadOnly)) return false;
+  QByteArray data = stateFile.readAll();
+  stateFile.close();
+
+  bool wasRunning = isRunning();
+  running = false;
+  wait();
+
+  const uint8 *bytes = (const uint8 *)data.constData();
+  vector<uint8> buffer(bytes, bytes + data.size());
+  bool loaded = loadState(buffer);
+  if (loaded) movie.stop();
+
+  if (wasRunning) start(QThread::HighestPriority);
+  return loaded;
+}
+
+// **************************************************
+// **************************************************
+// Movie Functions
+// **************************************************
+// **************************************************
+
+// record a movie from power on or from the
+// current state, the emulation thread is
+// stopped while recording starts
+void CGB::recordMovie(bool fromPowerOn) {
+  if (romPath == QDir::currentPath()) return;
+  running = false;
+  wait();
+  movie.record(fromPowerOn);
+  start(QThread::HighestPriority);
+}
+
+// play a movie from its start, the current game
+// keeps running if the movie cannot be played
+bool CGB::playMovieFile(const QString &path) {
+  if (romPath == QDir::currentPath()) return false;
+  bool wasRunning = isRunning();
+  running = false;
+  wait();
+
+  bool played = movie.load(path) && movie.play();
+
+  if (played || wasRunning) start(QThread::HighestPriority);
+  return played;
+}
+
+// stop recording or playing, the recorded movie
+// is kept until it is saved or replaced
+void CGB::stopMovie() {
+  bool wasRunning = isRunning();
+  running = false;
+  wait();
+  movie.stop();
+  if (wasRunning) start(QThread::HighestPriority);
+}
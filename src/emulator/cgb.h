@@ -17,25 +17,31 @@
 #include "bootstrap.h"
 #include "controls.h"
 #include "cpu.h"
+#include "framebuffer.h"
 #include "mbc.h"
 #include "memory.h"
+#include "movie.h"
 #include "ppu.h"
+#include "rewind.h"
 #include "rtc.h"
+#include "savestate.h"
 #include "timers.h"
 
 #define CPU_CLOCK_SPEED 0x100000
 #define FRAME_RATE 59.7275
 #define US_PER_SEC 1e6
 #define NS_PER_SEC 1e9
-#define NS_PER_CYCLE NS_PER_SEC / CPU_CLOCK_SPEED
+#define T_CYCLES_PER_SEC 0x400000
+#define T_CYCLES_PER_STEP 4
+#define T_CYCLES_PER_STEP_DOUBLE_SPEED 2
 #define FRAME_DURATION US_PER_SEC / 59.7275
+#define AUTO_FRAME_SKIP -1
+#define MAX_RUN_AHEAD_FRAMES 3
+#define STATE_EXTENSION ".state"
 
 class CGB : public QThread {
   Q_OBJECT
 
- private:
-  QImage screen;
-
  public:
   Bootstrap bootstrap;
   Controls controls;
@@ -46,27 +52,75 @@ class CGB : public QThread {
   APU apu;
   Timers timers;
   RTC rtc;
+  Rewind rewind;
+  Movie movie;
+  FrameBuffer frameBuffer;
 
   QString romPath;
   QAction *actionPause;
   bool stop, cgbMode, dmgMode, doubleSpeedMode;
-  bool running, pause;
+
+  // master clock in t-cycles at normal speed,
+  // advanced by each cpu machine cycle which is
+  // only two t-cycles long in double speed mode
+  uint64 masterClock;
+  uint8 cyclesPerStep;
+
+  // frames completed by the ppu since startup
+  uint64 frameNumber;
+  bool running, pause, behindRealTime, rewinding;
   Palette *tempPalette;
 
+  // clones never read or write battery saves
+  bool persistSaves;
+
+  // frames emulated ahead of each real frame,
+  // the state before them is kept in runAheadState
+  uint8 runAheadFrames;
+  vector<uint8> runAheadState;
+
+  // holds the previous state while loading a
+  // state and the state handed to a clone
+  vector<uint8> scratchState;
+
   CGB();
   ~CGB();
 
   void run() override;
+  void step();
+  void runFrame();
   void reset(bool newGame = true);
   bool loadRom(const QString romPath);
   void renderInPauseMode();
+  void setDoubleSpeedMode(bool enabled);
+  void advanceClock();
+  void syncToAudio();
+  void runAhead();
+
+  // save state functions
+  uint16 romChecksum() const;
+  void snapshot(vector<uint8> &buffer);
+  bool restore(const vector<uint8> &buffer);
+  bool loadState(const vector<uint8> &buffer);
+  unique_ptr<CGB> clone();
+  QString statePath() const;
+  bool saveStateFile();
+  bool loadStateFile();
+
+  // movie functions
+  void recordMovie(bool fromPowerOn);
+  bool playMovieFile(const QString &path);
+  void stopMovie();
 
  signals:
-  void sendScreen(const QImage *screen);
+  void sendScreen();
 
  public slots:
   void setDevice(bool cgb);
   void toggleDmgBootstrap(bool skip);
+  void toggleFastBoot(bool fast);
+  void setFrameSkip(int frames);
+  void setRunAhead(int frames);
   void previewPalette(Palette *palette);
   void resetPreviewPalette();
   void togglePause(bool shouldPause);
@@ -0,0 +1,50 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Color Table (CGB Color Correction)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "colortable.h"
+
+#include <cmath>
+#include <mutex>
+
+// get lookup table for profile, safe to call
+// from the emulation and render threads
+const uint *ColorTable::get(ColorProfile profile) {
+  static array<uint, COLOR_TABLE_SIZE> tables[COLOR_PROFILE_COUNT];
+  static once_flag built[COLOR_PROFILE_COUNT];
+  call_once(built[profile], [profile] {
+    for (uint16 color = 0; color < COLOR_TABLE_SIZE; ++color) {
+      tables[profile][color] = convert(profile, color);
+    }
+  });
+  return tables[profile].data();
+}
+
+// convert 15-bit cgb color to 32-bit argb color
+uint ColorTable::convert(ColorProfile profile, uint16 color) {
+  uint red = color & FIVE_BITS_MASK;
+  uint green = (color >> 5) & FIVE_BITS_MASK;
+  uint blue = (color >> 10) & FIVE_BITS_MASK;
+
+  switch (profile) {
+    case GAMMA_COLORS: {
+      auto curve = [](uint channel) {
+        return (int)round(255 * pow(channel / 31.0, COLOR_GAMMA));
+      };
+      return qRgb(curve(red), curve(green), curve(blue));
+    }
+
+    // channel mixing used by gambatte to
+    // approximate the gbc lcd colors
+    case GBC_LCD_COLORS:
+      return qRgb((red * 13 + green * 2 + blue) >> 1, (green * 3 + blue) << 1,
+                  (red * 3 + green * 2 + blue * 11) >> 1);
+
+    default:
+      return qRgb(red * 8, green * 8, blue * 8);
+  }
+}
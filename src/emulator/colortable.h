@@ -0,0 +1,42 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Color Table (CGB Color Correction)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <QImage>
+#include <array>
+
+#include "types.h"
+
+// one entry per 15-bit cgb color
+#define COLOR_TABLE_SIZE 0x8000
+
+// curve applied by the gamma corrected profile
+#define COLOR_GAMMA 1.4
+
+using namespace std;
+
+// raw expands each 5-bit channel as is, gamma
+// darkens midtones with a gamma curve and gbc lcd
+// also mixes channels like the gbc lcd panel
+enum ColorProfile : uint8 {
+  RAW_COLORS,
+  GAMMA_COLORS,
+  GBC_LCD_COLORS,
+  COLOR_PROFILE_COUNT
+};
+
+// rgb555 to argb lookup tables, each profile's
+// table is built the first time it is requested
+class ColorTable {
+ private:
+  static uint convert(ColorProfile profile, uint16 color);
+
+ public:
+  static const uint *get(ColorProfile profile);
+};
@@ -21,7 +21,19 @@ Controls::Controls()
       buttonToMask{{RIGHT, RIGHT_A_MASK},    {LEFT, LEFT_B_MASK},
                    {UP, UP_SELECT_MASK},     {DOWN, DOWN_START_MASK},
                    {A, RIGHT_A_MASK},        {B, LEFT_B_MASK},
-                   {SELECT, UP_SELECT_MASK}, {START, DOWN_START_MASK}} {}
+                   {SELECT, UP_SELECT_MASK}, {START, DOWN_START_MASK}},
+      latched(false),
+      latchedButtons(0) {}
+
+// buttons currently held on the keyboard,
+// bit n is set if button n is held
+uint8 Controls::heldButtons() const {
+  uint8 buttons = 0;
+  for (const auto &button : state) {
+    if (button.second) buttons |= 1 << button.first;
+  }
+  return buttons;
+}
 
 // update joypad register P1 based on
 // the keys currently being pressed on
@@ -59,11 +71,12 @@ void Controls::update() {
   // iterate over each button
   for (auto button : buttons) {
     uint8 mask = buttonToMask.at(button);
+    bool held = latched ? latchedButtons & (1 << button) : state[button];
 
     // if key corresponding to the current
     // button is pressed, set its corresponding
     // bit in P1 to 0
-    if (state[button]) {
+    if (held) {
       p1 &= ~mask;
 
       // request joypad interrupt if button
@@ -38,8 +38,15 @@ class Controls {
   map<int, Button> keyBindings;
   const map<Button, uint8> buttonToMask;
 
+  // while a movie is recorded or played the
+  // buttons are latched once per frame, bit n
+  // of latchedButtons is set if button n is held
+  bool latched;
+  uint8 latchedButtons;
+
   Controls();
 
+  uint8 heldButtons() const;
   void update();
   void press(int key);
   void release(int key);
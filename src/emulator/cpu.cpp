@@ -13,6 +13,7 @@
 #include "log.h"
 #include "memory.h"
 #include "ppu.h"
+#include "savestate.h"
 #include "timers.h"
 
 uint8 cyc = 0;
@@ -104,6 +105,7 @@ void CPU::step() {
 void CPU::ppuTimerSerialStep(int cycles) {
   cpuCycles += cycles;
   for (int i = 0; i < cycles; ++i) {
+    cgb->advanceClock();
     cgb->ppu.step();
     cgb->timers.step();
   }
@@ -123,8 +125,66 @@ bool CPU::serialTransferComplete() {
 void CPU::reset() {
   PC = SP = A = BC = DE = HL = 0;
   carry = halfCarry = subtract = zero = IME = halt = shouldSetIME =
-      triggerHaltBug = false;
+      triggerHaltBug = serialTransferMode = false;
   delaySetIME = true;
+  serialTransferCycles = 0;
+}
+
+// set registers as left by the bootstrap
+void CPU::setRegisters(uint16 AF, uint16 BC, uint16 DE, uint16 HL, uint16 SP,
+                       uint16 PC) {
+  setAF(AF);
+  this->BC = BC;
+  this->DE = DE;
+  this->HL = HL;
+  this->SP = SP;
+  this->PC = PC;
+}
+
+// save registers, flags and the interrupt and
+// serial state that spans instructions
+void CPU::saveState(StateWriter &state) const {
+  state.beginSection(CPU_SECTION);
+  state.write(PC);
+  state.write(SP);
+  state.write(BC);
+  state.write(DE);
+  state.write(HL);
+  state.write(A);
+  state.write(zero);
+  state.write(subtract);
+  state.write(halfCarry);
+  state.write(carry);
+  state.write(IME);
+  state.write(halt);
+  state.write(shouldSetIME);
+  state.write(delaySetIME);
+  state.write(triggerHaltBug);
+  state.write(serialTransferCycles);
+  state.write(serialTransferMode);
+  state.write(cpuCycles);
+  state.endSection();
+}
+
+void CPU::loadState(StateReader &state) {
+  state.read(PC);
+  state.read(SP);
+  state.read(BC);
+  state.read(DE);
+  state.read(HL);
+  state.read(A);
+  state.read(zero);
+  state.read(subtract);
+  state.read(halfCarry);
+  state.read(carry);
+  state.read(IME);
+  state.read(halt);
+  state.read(shouldSetIME);
+  state.read(delaySetIME);
+  state.read(triggerHaltBug);
+  state.read(serialTransferCycles);
+  state.read(serialTransferMode);
+  state.read(cpuCycles);
 }
 
 // **************************************************
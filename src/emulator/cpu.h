@@ -45,6 +45,8 @@
 #define JOYPAD_INT 0x10
 
 class CGB;
+class StateReader;
+class StateWriter;
 
 class CPU {
  private:
@@ -116,6 +118,10 @@ class CPU {
   void step();
   void ppuTimerSerialStep(int cycles);
   void reset();
+  void setRegisters(uint16 AF, uint16 BC, uint16 DE, uint16 HL, uint16 SP,
+                    uint16 PC);
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 
   // public interrupt function
   void requestInterrupt(uint8 interrupt);
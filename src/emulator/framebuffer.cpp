@@ -0,0 +1,90 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Frame Buffer (Triple Buffered Screen)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "framebuffer.h"
+
+FrameBuffer::FrameBuffer(int width, int height)
+    : buffers{QImage(width, height, QImage::Format_RGB32),
+              QImage(width, height, QImage::Format_RGB32),
+              QImage(width, height, QImage::Format_RGB32)},
+      colorPlanes{vector<uint16>(width * height),
+                  vector<uint16>(width * height),
+                  vector<uint16>(width * height)},
+      frameHashes(),
+      backIdx(0),
+      frontIdx(1),
+      middleIdx(2) {
+  for (auto &buffer : buffers) buffer.fill(0);
+}
+
+// get buffer the ppu should draw into
+QImage *FrameBuffer::back() { return &buffers[backIdx]; }
+
+// get colors of the pixels in the back buffer
+uint16 *FrameBuffer::backColors() { return colorPlanes[backIdx].data(); }
+
+// mark back buffer as a completed frame by
+// swapping it with the middle buffer, the old
+// middle buffer becomes the new back buffer
+void FrameBuffer::publish() {
+  frameHashes[backIdx] = hashFrame(buffers[backIdx]);
+
+  uint8 oldMiddleIdx = middleIdx.exchange(backIdx | FRESH_FRAME_MASK,
+                                          memory_order_acq_rel);
+  backIdx = oldMiddleIdx & ~FRESH_FRAME_MASK;
+}
+
+// get newest completed frame, if no new frame
+// has been published since the last call then
+// the previously presented frame is returned
+const QImage *FrameBuffer::acquire() {
+  if (middleIdx.load(memory_order_acquire) & FRESH_FRAME_MASK) {
+    uint8 oldMiddleIdx = middleIdx.exchange(frontIdx, memory_order_acq_rel);
+    frontIdx = oldMiddleIdx & ~FRESH_FRAME_MASK;
+  }
+  return &buffers[frontIdx];
+}
+
+// get frame last returned by acquire, only the
+// presentation thread may modify it
+QImage *FrameBuffer::front() { return &buffers[frontIdx]; }
+
+// get colors of the pixels in the front buffer
+const uint16 *FrameBuffer::frontColors() const {
+  return colorPlanes[frontIdx].data();
+}
+
+// get hash of the front buffer, equal hashes
+// mean the frames are pixel identical
+uint64 FrameBuffer::frontHash() const { return frameHashes[frontIdx]; }
+
+// hash front buffer again after the
+// presentation thread modified it
+void FrameBuffer::rehashFront() {
+  frameHashes[frontIdx] = hashFrame(buffers[frontIdx]);
+}
+
+// hash a frame from the hashes of its lines
+uint64 FrameBuffer::hashFrame(const QImage &image) {
+  uint64 hash = FRAME_HASH_BASIS;
+  for (int y = 0; y < image.height(); ++y) {
+    hash = (hash ^ hashLine(image, y)) * FRAME_HASH_PRIME;
+  }
+  return hash;
+}
+
+// hash a line of pixels eight bytes at a time
+uint64 FrameBuffer::hashLine(const QImage &image, int y) {
+  auto words = (const uint64 *)image.constScanLine(y);
+  int wordCount = image.width() * sizeof(uint) / sizeof(uint64);
+  uint64 hash = FRAME_HASH_BASIS;
+  for (int i = 0; i < wordCount; ++i) {
+    hash = (hash ^ words[i]) * FRAME_HASH_PRIME;
+  }
+  return hash;
+}
@@ -0,0 +1,64 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Frame Buffer (Triple Buffered Screen)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <QImage>
+#include <atomic>
+#include <vector>
+
+#include "types.h"
+
+#define FRAME_BUFFER_COUNT 3
+
+// set in the shared buffer index when the
+// buffer it points to holds a completed
+// frame that has not been presented yet
+#define FRESH_FRAME_MASK 0x04
+
+// frame hash constants (64-bit fnv-1a)
+#define FRAME_HASH_BASIS 0xCBF29CE484222325ULL
+#define FRAME_HASH_PRIME 0x100000001B3ULL
+
+using namespace std;
+
+// the ppu always draws into the back buffer and the
+// presenter always reads from the front buffer, the
+// middle buffer is handed between them with a single
+// atomic exchange so neither side ever blocks or copies,
+// each buffer also keeps the palette independent color
+// of every pixel so the frame can be recolored later,
+// a hash of every frame is computed when it is
+// published so consumers can skip work for frames
+// that did not change
+class FrameBuffer {
+ private:
+  QImage buffers[FRAME_BUFFER_COUNT];
+  vector<uint16> colorPlanes[FRAME_BUFFER_COUNT];
+  uint64 frameHashes[FRAME_BUFFER_COUNT];
+  uint8 backIdx, frontIdx;
+  atomic<uint8> middleIdx;
+
+ public:
+  FrameBuffer(int width, int height);
+
+  // emulation thread functions
+  QImage *back();
+  uint16 *backColors();
+  void publish();
+
+  // presentation thread functions
+  const QImage *acquire();
+  QImage *front();
+  const uint16 *frontColors() const;
+  uint64 frontHash() const;
+  void rehashFront();
+
+  static uint64 hashFrame(const QImage &image);
+  static uint64 hashLine(const QImage &image, int y);
+};
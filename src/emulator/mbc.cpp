@@ -12,6 +12,7 @@
 
 #include "memory.h"
 #include "rtc.h"
+#include "savestate.h"
 
 MBC::MBC()
     : mem(nullptr),
@@ -162,15 +163,18 @@ void MBC::mbc3(uint16 addr, uint8 val) {
       mem->setExramBank(ramBankNum);
     }
 
-    // rtc register select
-    else {
-      rtc->rtcReg = rtc->rtcRegs[val - RTC_REG_START_IDX];
+    // rtc register select, the register is
+    // mapped in place of external ram
+    else if (val >= RTC_REG_START_IDX &&
+             val < RTC_REG_START_IDX + RTC_REG_COUNT) {
+      ramBankNum = val;
+      rtc->select(val);
     }
   }
 
   // latch clock data register
   else if (addr < MBC3_LATCH_CLOCK_DATA) {
-    rtc->latch();
+    rtc->latch(val);
   }
 }
 
@@ -403,3 +407,23 @@ void MBC::reset() {
   ramBankNum = 0;
   bankMode = false;
 }
+
+// save bank registers, the memory banks they
+// select are saved with memory
+void MBC::saveState(StateWriter &state) const {
+  state.beginSection(MBC_SECTION);
+  state.write(romBankNum);
+  state.write(ramBankNum);
+  state.write(ramEnabled);
+  state.write(bankMode);
+  state.write(romBankBit9);
+  state.endSection();
+}
+
+void MBC::loadState(StateReader &state) {
+  state.read(romBankNum);
+  state.read(ramBankNum);
+  state.read(ramEnabled);
+  state.read(bankMode);
+  state.read(romBankBit9);
+}
@@ -77,6 +77,8 @@
 
 class Memory;
 class RTC;
+class StateReader;
+class StateWriter;
 
 using namespace std;
 
@@ -119,4 +121,6 @@ class MBC {
   bool hasTimerAndBattery() const;
   int ramBytes() const;
   void reset();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
@@ -8,11 +8,17 @@
 
 #include "memory.h"
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <mutex>
+
 #include "bootstrap.h"
 #include "cgb.h"
 #include "cpu.h"
 #include "log.h"
 #include "mbc.h"
+#include "savestate.h"
 
 // **************************************************
 // **************************************************
@@ -36,7 +42,9 @@
 Memory::Memory()
     : cgb(nullptr),
       mem((uint8 *)malloc(MEM_BYTES)),
-      cart((uint8 *)malloc(CART_BYTES)),
+      cartImage(blankCart()),
+      cart(cartImage.get()),
+      romBanks(MIN_ROM_BANKS),
       vram((uint8 *)malloc(RAM_BANK_BYTES * VRAM_BANKS)),
       exram((uint8 *)malloc(RAM_BANK_BYTES * EXRAM_BANKS)),
       wram((uint8 *)malloc(WRAM_BANK_BYTES * WRAM_BANKS)),
@@ -82,7 +90,7 @@ uint8 Memory::read(uint16 addr) const {
     // mapped to an rtc register, read
     // from rtc register
     if (cgb->mbc.usingMbc3() && cgb->mbc.ramBankNum >= RTC_REG_START_IDX) {
-      return *cgb->rtc.rtcReg;
+      return cgb->rtc.read();
     }
   }
 
@@ -151,6 +159,14 @@ void Memory::write(uint16 addr, uint8 val) {
   // rom bank area is read-only
   if (addr < VRAM_ADDR) return;
 
+  // scanlines deferred for parallel rendering
+  // read from vram and cram, so they must be
+  // drawn before either is modified
+  if ((addr >= VRAM_ADDR && addr < EXRAM_ADDR) || addr == HDMA5 ||
+      addr == BCPD || addr == OCPD) {
+    cgb->ppu.displayMemoryWritten();
+  }
+
   // external memory write
   if (addr >= EXRAM_ADDR && addr < WRAM_ADDR) {
     // cannot access external ram if it
@@ -170,8 +186,7 @@ void Memory::write(uint16 addr, uint8 val) {
     // mapped to an rtc register, write
     // to rtc register
     if (cgb->mbc.usingMbc3() && cgb->mbc.ramBankNum >= RTC_REG_START_IDX) {
-      *cgb->rtc.rtcReg = val;
-      cgb->rtc.resetClock();
+      cgb->rtc.write(val);
       return;
     }
   }
@@ -194,10 +209,10 @@ void Memory::write(uint16 addr, uint8 val) {
     return;
   }
 
-  // only bit 7 of register NR52 can
-  // be written to
-  if (addr == NR52) {
-    writeBits(addr, val, {7});
+  // sound registers and wave ram are
+  // handled by the apu
+  if (addr >= NR10 && addr < WAVE_RAM_END) {
+    cgb->apu.write(addr, val);
     return;
   }
 
@@ -213,7 +228,7 @@ void Memory::write(uint16 addr, uint8 val) {
   // be written to
   if (addr == KEY1) {
     writeBits(addr, val, {0});
-    if (val & BIT0_MASK) cgb->doubleSpeedMode = !cgb->doubleSpeedMode;
+    if (val & BIT0_MASK) cgb->setDoubleSpeedMode(!cgb->doubleSpeedMode);
     writeBits(addr, cgb->doubleSpeedMode << 7, {7});
     return;
   }
@@ -276,6 +291,12 @@ void Memory::write(uint16 addr, uint8 val) {
   // Post-Write Actions
   // **************************************************
 
+  // keep ppu sprite lines up
+  // to date with oam
+  if (addr >= OAM_ADDR && addr < OAM_END_ADDR) {
+    cgb->ppu.oamWritten(addr);
+  }
+
   // start oam dma transfer if DMA
   // register was written to
   if (addr == DMA) {
@@ -404,11 +425,96 @@ uint8 &Memory::getVramByte(uint16 addr, bool bank) const {
 // **************************************************
 // **************************************************
 
-// load rom at the given directory into memory
+// rom images loaded in this process, keyed by
+// path, size and modification time, an image is
+// freed once no instance uses it
+struct CachedRom {
+  weak_ptr<uint8[]> image;
+  uint16 banks;
+};
+static map<QString, CachedRom> romCache;
+static mutex romCacheMutex;
+
+// banks given by the rom size in the header, or
+// enough banks for the file if the size is invalid
+static uint16 romBankCount(uint8 sizeCode, qint64 fileBytes) {
+  if (sizeCode <= MAX_ROM_SIZE) return MIN_ROM_BANKS << sizeCode;
+  uint16 banks = MIN_ROM_BANKS;
+  while (banks < CART_BYTES / ROM_BANK_BYTES &&
+         (qint64)banks * ROM_BANK_BYTES < fileBytes) {
+    banks <<= 1;
+  }
+  return banks;
+}
+
+// empty cartridge shared by every instance
+// until a rom is loaded
+shared_ptr<uint8[]> Memory::blankCart() {
+  static shared_ptr<uint8[]> blank(
+      new uint8[MIN_ROM_BANKS * ROM_BANK_BYTES]());
+  return blank;
+}
+
+// map the banks of a rom file, the mapping is
+// private so the file is never written, roms
+// shorter than their header size are read into
+// a zeroed image instead
+shared_ptr<uint8[]> Memory::mapRom(const QString &path, uint16 &banks) {
+  banks = MIN_ROM_BANKS;
+  auto romFile = make_shared<QFile>(path);
+  if (!romFile->open(QIODevice::ReadOnly)) return blankCart();
+
+  QByteArray header = romFile->read(ROM_SIZE + 1);
+  uint8 sizeCode = header.size() > ROM_SIZE ? header[ROM_SIZE] : 0;
+  banks = romBankCount(sizeCode, romFile->size());
+  qint64 bytes = (qint64)banks * ROM_BANK_BYTES;
+  if (romFile->size() >= bytes) {
+    uchar *data = romFile->map(0, bytes, QFileDevice::MapPrivateOption);
+    if (data) {
+      return shared_ptr<uint8[]>(
+          data, [romFile](uint8 *data) { romFile->unmap(data); });
+    }
+  }
+
+  shared_ptr<uint8[]> image(new uint8[bytes]());
+  romFile->seek(0);
+  romFile->read((char *)image.get(), min(bytes, romFile->size()));
+  return image;
+}
+
+// use the cartridge image of another instance,
+// banks are set when the state is restored
+void Memory::shareCart(const Memory &other) {
+  cartImage = other.cartImage;
+  cart = cartImage.get();
+  romBanks = other.romBanks;
+  setRomBank(&romBank0, 0);
+  setRomBank(&romBank1, 1);
+}
+
+// load rom at the given directory, instances that
+// load the same file share its image, a new image
+// is used when the file changed since clones may
+// still be reading the previous one
 void Memory::loadRom(QString dir) {
-  fstream fs(dir.toStdString());
-  fs.read((char *)cart, CART_BYTES);
-  fs.close();
+  QFileInfo romInfo(dir);
+  QString key = romInfo.canonicalFilePath() + ":" +
+                QString::number(romInfo.size()) + ":" +
+                QString::number(romInfo.lastModified().toMSecsSinceEpoch());
+  {
+    lock_guard<mutex> lock(romCacheMutex);
+    for (auto it = romCache.begin(); it != romCache.end();) {
+      it = it->second.image.expired() ? romCache.erase(it) : next(it);
+    }
+    CachedRom &cached = romCache[key];
+    cartImage = cached.image.lock();
+    if (!cartImage) {
+      cartImage = mapRom(dir, cached.banks);
+      cached.image = cartImage;
+    }
+    romBanks = cached.banks;
+  }
+  cart = cartImage.get();
 
   // set default memory banks
   setRomBank(&romBank0, 0);
@@ -418,9 +524,12 @@ void Memory::loadRom(QString dir) {
   setWramBank(1);
 }
 
-// map memory rom bank to cartridge rom bank
+// map memory rom bank to cartridge rom bank,
+// bank numbers past the end of the rom wrap
+// around since the upper bank bits are not
+// connected
 void Memory::setRomBank(uint8 **romBank, uint16 bankNum) {
-  *romBank = &cart[ROM_BANK_BYTES * bankNum];
+  *romBank = &cart[ROM_BANK_BYTES * (bankNum & (romBanks - 1))];
 }
 
 // set video ram bank (cgb only)
@@ -453,6 +562,7 @@ void Memory::oamDmaTransfer() {
   for (int i = 0; i < OAM_ENTRY_COUNT * OAM_ENTRY_BYTES; ++i) {
     getByte(OAM_ADDR + i) = (uint8)getByte(dmaAddr + i);
   }
+  cgb->ppu.refreshOam();
 }
 
 // perform vram dma transfer
@@ -546,3 +656,72 @@ void Memory::reset() {
   bcpd = &cramBg[0];
   ocpd = &cramObj[0];
 }
+
+// **************************************************
+// **************************************************
+// Save State Functions
+// **************************************************
+// **************************************************
+
+// bytes of external ram in use, mbc2 echoes its
+// half ram across the whole first bank
+static uint32 exramStateBytes(const MBC &mbc) {
+  return max(mbc.ramBytes(), mbc.halfRAMMode ? RAM_BANK_BYTES : 0);
+}
+
+// save memory, banks are stored as bank numbers
+// since the pointers are only valid in this process
+void Memory::saveState(StateWriter &state) const {
+  state.beginSection(MEMORY_SECTION);
+  state.writeBytes(mem, MEM_BYTES);
+  state.writeBytes(vram, RAM_BANK_BYTES * VRAM_BANKS);
+  state.writeBytes(wram, WRAM_BANK_BYTES * WRAM_BANKS);
+  uint32 exramBytes = exramStateBytes(cgb->mbc);
+  state.write(exramBytes);
+  state.writeBytes(exram, exramBytes);
+  state.write(cramBg);
+  state.write(cramObj);
+  state.write((uint16)((romBank0 - cart) / ROM_BANK_BYTES));
+  state.write((uint16)((romBank1 - cart) / ROM_BANK_BYTES));
+  state.write((uint8)((vramBank - vram) / RAM_BANK_BYTES));
+  state.write((uint8)((exramBank - exram) / RAM_BANK_BYTES));
+  state.write((uint8)((wramBank - wram) / WRAM_BANK_BYTES));
+  state.write((uint8)(bcpd - cramBg));
+  state.write((uint8)(ocpd - cramObj));
+  state.endSection();
+}
+
+void Memory::loadState(StateReader &state) {
+  state.readBytes(mem, MEM_BYTES);
+  state.readBytes(vram, RAM_BANK_BYTES * VRAM_BANKS);
+  state.readBytes(wram, WRAM_BANK_BYTES * WRAM_BANKS);
+
+  // external ram must match the loaded cartridge
+  uint32 exramBytes = 0;
+  state.read(exramBytes);
+  if (exramBytes != exramStateBytes(cgb->mbc)) {
+    state.fail();
+    return;
+  }
+  state.readBytes(exram, exramBytes);
+  state.read(cramBg);
+  state.read(cramObj);
+
+  uint16 romBank0Num = 0, romBank1Num = 1;
+  uint8 vramBankNum = 0, exramBankNum = 0, wramBankNum = 1;
+  uint8 bcpdIdx = 0, ocpdIdx = 0;
+  state.read(romBank0Num);
+  state.read(romBank1Num);
+  state.read(vramBankNum);
+  state.read(exramBankNum);
+  state.read(wramBankNum);
+  state.read(bcpdIdx);
+  state.read(ocpdIdx);
+  setRomBank(&romBank0, romBank0Num);
+  setRomBank(&romBank1, romBank1Num);
+  setVramBank(vramBankNum % VRAM_BANKS);
+  setExramBank(exramBankNum % EXRAM_BANKS);
+  setWramBank(wramBankNum % WRAM_BANKS);
+  bcpd = &cramBg[bcpdIdx % sizeof(cramBg)];
+  ocpd = &cramObj[ocpdIdx % sizeof(cramObj)];
+}
@@ -11,6 +11,7 @@
 #include <QString>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "types.h"
@@ -19,6 +20,7 @@
 #define MEM_BYTES 0x2000
 #define CART_BYTES 0x800000
 #define ROM_BANK_BYTES 0x4000
+#define MIN_ROM_BANKS 2
 #define RAM_BANK_BYTES 0x2000
 #define WRAM_BANK_BYTES 0x1000
 #define PAL_RAM_BYTES 0x40
@@ -30,11 +32,23 @@
 #define PAL_COUNT 8
 
 // cartridge header addresses
+#define LOGO 0x0104
+#define LOGO_BYTES 0x30
+#define TITLE 0x0134
+#define TITLE_BYTES 0x10
 #define CGB_MODE 0x0143
+#define NEW_LICENSEE 0x0144
 #define SGB_MODE 0x0146
 #define BANK_TYPE 0x0147
 #define ROM_SIZE 0x0148
 #define RAM_SIZE 0x0149
+#define OLD_LICENSEE 0x014B
+#define HEADER_CHECKSUM 0x014D
+#define GLOBAL_CHECKSUM 0x014E
+
+// largest rom size code, the rom has
+// 2 << code banks
+#define MAX_ROM_SIZE 0x08
 
 // hardware registers
 #define P1 0xFF00         // joypad register
@@ -67,6 +81,7 @@
 #define NR51 0xFF25       // sound panning
 #define NR52 0xFF26       // sound on/off
 #define WAVE_RAM 0xFF30   // waveform data (up to 0xFF3F)
+#define WAVE_RAM_END 0xFF40
 #define LCDC 0xFF40       // lcd control
 #define STAT 0xFF41       // lcd status
 #define SCY 0xFF42        // scroll y
@@ -80,6 +95,7 @@
 #define BOOTSTRAP 0xFF50  // enable/disable bootstrap
 #define WY 0xFF4A         // window y position
 #define WX 0xFF4B         // window x position
+#define KEY0 0xFF4C       // cpu mode select (cgb only)
 #define KEY1 0xFF4D       // prepare speed switch (cgb only)
 #define VBK 0xFF4F        // vram bank (cgb only)
 #define HDMA1 0xFF51      // vram dma source high (cgb only)
@@ -107,12 +123,15 @@
 #define WRAM_BANK_ADDR 0xD000
 #define ECHO_RAM_ADDR 0xE000
 #define OAM_ADDR 0xFE00
+#define OAM_END_ADDR 0xFEA0
 #define ZERO_PAGE_ADDR 0xFF00
 #define HRAM_ADDR 0xFF80
 
 using namespace std;
 
 class CGB;
+class StateReader;
+class StateWriter;
 
 class Memory {
  private:
@@ -127,9 +146,13 @@ class Memory {
  public:
   CGB *cgb;
 
-  // allocated memory
+  // allocated memory, the cartridge image is
+  // read-only and shared with clones and other
+  // instances that loaded the same rom
   uint8 *mem;
+  shared_ptr<uint8[]> cartImage;
   uint8 *cart;
+  uint16 romBanks;
   uint8 *vram;
   uint8 *exram;
   uint8 *wram;
@@ -170,10 +193,15 @@ class Memory {
   uint16 vramTransferLength() const;
 
   // save + load functions
+  static shared_ptr<uint8[]> blankCart();
+  static shared_ptr<uint8[]> mapRom(const QString &path, uint16 &banks);
+  void shareCart(const Memory &other);
   void loadRom(QString dir);
   void loadExram();
   void saveExram();
 
   // reset memory
   void reset();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
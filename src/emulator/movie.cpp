@@ -0,0 +1,199 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Movie (Joypad Input Recording + Playback)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "movie.h"
+
+#include <QFile>
+
+#include "cgb.h"
+
+Movie::Movie()
+    : startState(),
+      inputs(),
+      playPos(0),
+      rtcEmulatedTime(false),
+      cgb(nullptr),
+      mode(MOVIE_OFF),
+      romChecksum(0),
+      cgbMode(false),
+      fromPowerOn(true),
+      fastBoot(false),
+      skipDmg(false),
+      rtcSeed(0),
+      userSkipDmg(false) {}
+
+// start recording from power on or from the
+// current state, must not be called while the
+// emulation thread is running
+void Movie::record(bool powerOn) {
+  stop();
+  romChecksum = cgb->romChecksum();
+  cgbMode = cgb->cgbMode;
+  fromPowerOn = powerOn;
+  fastBoot = cgb->bootstrap.fastBoot;
+  skipDmg = cgb->bootstrap.skipDmg;
+  rtcSeed = cgb->rtc.time();
+  if (fromPowerOn) {
+    startState.clear();
+  } else {
+    cgb->snapshot(startState);
+  }
+  inputs.clear();
+  if (!begin()) return;
+  mode = MOVIE_RECORDING;
+  nextFrame();
+}
+
+// play the loaded movie from its start, fails
+// if it was recorded with another rom or device
+bool Movie::play() {
+  stop();
+  if (!begin()) return false;
+  mode = MOVIE_PLAYING;
+  nextFrame();
+  return true;
+}
+
+// put the emulator in the start state and latch
+// the buttons from now on, battery saves are
+// neither read nor written from here on so the
+// movie always sees the same cartridge ram, and
+// the rtc counts emulated time and the dmg
+// bootstrap is skipped as recorded until it stops
+bool Movie::begin() {
+  if (romChecksum != cgb->romChecksum() || cgbMode != cgb->cgbMode) {
+    return false;
+  }
+  rtcEmulatedTime = cgb->rtc.emulatedTime;
+  userSkipDmg = cgb->bootstrap.skipDmg;
+  cgb->rtc.setEmulatedTime(true);
+  cgb->bootstrap.skipDmg = skipDmg;
+  if (fromPowerOn) {
+    // boot the way the movie was recorded
+    bool userFastBoot = cgb->bootstrap.fastBoot;
+    cgb->bootstrap.fastBoot = fastBoot;
+    cgb->reset(true);
+    cgb->bootstrap.fastBoot = userFastBoot;
+    cgb->rtc.setTime(rtcSeed);
+  } else if (!cgb->loadState(startState)) {
+    cgb->rtc.setEmulatedTime(rtcEmulatedTime);
+    cgb->bootstrap.skipDmg = userSkipDmg;
+    return false;
+  }
+  cgb->persistSaves = false;
+  cgb->controls.latched = true;
+  playPos = 0;
+  return true;
+}
+
+void Movie::stop() {
+  if (mode != MOVIE_OFF) {
+    cgb->rtc.setEmulatedTime(rtcEmulatedTime);
+    cgb->bootstrap.skipDmg = userSkipDmg;
+  }
+  mode = MOVIE_OFF;
+  cgb->controls.latched = false;
+}
+
+// called as each frame starts, records the
+// buttons held for the frame or latches the
+// recorded ones, so keys pressed mid frame take
+// effect at the same point on every playback
+void Movie::nextFrame() {
+  if (mode == MOVIE_RECORDING) {
+    inputs.push_back(cgb->controls.heldButtons());
+    cgb->controls.latchedButtons = inputs.back();
+  } else if (mode == MOVIE_PLAYING) {
+    if (playPos < inputs.size()) {
+      cgb->controls.latchedButtons = inputs[playPos++];
+    } else {
+      stop();
+    }
+  }
+}
+
+size_t Movie::frameCount() const { return inputs.size(); }
+
+bool Movie::save(const QString &path) const {
+  vector<uint8> buffer;
+  StateWriter movie(buffer, MOVIE_MAGIC, MOVIE_VERSION);
+  movie.beginSection(MOVIE_HEADER_SECTION);
+  movie.write(romChecksum);
+  movie.write(cgbMode);
+  movie.write(fromPowerOn);
+  movie.write(rtcSeed);
+  movie.write(fastBoot);
+  movie.write(skipDmg);
+  movie.endSection();
+  if (!fromPowerOn) {
+    movie.beginSection(MOVIE_STATE_SECTION);
+    movie.writeBytes(startState.data(), startState.size());
+    movie.endSection();
+  }
+  movie.beginSection(MOVIE_INPUT_SECTION);
+  movie.writeBytes(inputs.data(), inputs.size());
+  movie.endSection();
+
+  QFile movieFile(path);
+  return movieFile.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+         movieFile.write((const char *)buffer.data(), buffer.size()) ==
+             (qint64)buffer.size();
+}
+
+// load a movie without starting it, the loaded
+// movie is kept if the file is invalid
+bool Movie::load(const QString &path) {
+  QFile movieFile(path);
+  if (!movieFile.open(QIODevice::ReadOnly)) return false;
+  QByteArray data = movieFile.readAll();
+  StateReader movie((const uint8 *)data.constData(), data.size(), MOVIE_MAGIC,
+                    MOVIE_VERSION);
+  if (!movie.validate({MOVIE_HEADER_SECTION, MOVIE_INPUT_SECTION})) {
+    return false;
+  }
+
+  uint16 movieChecksum = 0;
+  bool movieCgbMode = false, movieFromPowerOn = true, movieFastBoot = false,
+       movieSkipDmg = false;
+  uint64 movieRtcSeed = 0;
+  vector<uint8> movieState, movieInputs;
+  uint32 tag = 0;
+  while (movie.nextSection(tag)) {
+    switch (tag) {
+      case MOVIE_HEADER_SECTION:
+        movie.read(movieChecksum);
+        movie.read(movieCgbMode);
+        movie.read(movieFromPowerOn);
+        movie.read(movieRtcSeed);
+        if (movie.version >= 2) movie.read(movieFastBoot);
+        if (movie.version >= 3) movie.read(movieSkipDmg);
+        break;
+      case MOVIE_STATE_SECTION:
+        movieState.resize(movie.remaining());
+        movie.readBytes(movieState.data(), movieState.size());
+        break;
+      case MOVIE_INPUT_SECTION:
+        movieInputs.resize(movie.remaining());
+        movie.readBytes(movieInputs.data(), movieInputs.size());
+        break;
+    }
+    if (!movie.ok()) return false;
+  }
+  if (!movieFromPowerOn && movieState.empty()) return false;
+
+  stop();
+  romChecksum = movieChecksum;
+  cgbMode = movieCgbMode;
+  fromPowerOn = movieFromPowerOn;
+  rtcSeed = movieRtcSeed;
+  fastBoot = movieFastBoot;
+  skipDmg = movieSkipDmg;
+  startState.swap(movieState);
+  inputs.swap(movieInputs);
+  return true;
+}
@@ -0,0 +1,67 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Movie (Joypad Input Recording + Playback)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <QString>
+#include <vector>
+
+#include "savestate.h"
+#include "types.h"
+
+// a movie uses the save state layout, the header
+// section says how playback starts, the state
+// section holds the start state if it does not
+// start from power on, and the input section
+// holds the buttons held in each frame
+#define MOVIE_MAGIC STATE_TAG('D', 'M', 'M', 'V')
+#define MOVIE_VERSION 3
+#define MOVIE_EXTENSION ".movie"
+
+#define MOVIE_HEADER_SECTION STATE_TAG('M', 'O', 'V', 'I')
+#define MOVIE_STATE_SECTION STATE_TAG('S', 'T', 'R', 'T')
+#define MOVIE_INPUT_SECTION STATE_TAG('I', 'N', 'P', 'T')
+
+using namespace std;
+
+class CGB;
+
+enum MovieMode { MOVIE_OFF, MOVIE_RECORDING, MOVIE_PLAYING };
+
+class Movie {
+ private:
+  vector<uint8> startState;
+  vector<uint8> inputs;
+  size_t playPos;
+  bool rtcEmulatedTime;
+
+  bool begin();
+
+ public:
+  CGB *cgb;
+  MovieMode mode;
+
+  // header of the loaded or recorded movie
+  uint16 romChecksum;
+  bool cgbMode, fromPowerOn, fastBoot, skipDmg;
+  uint64 rtcSeed;
+
+  // skip dmg bootstrap setting restored
+  // when the movie stops
+  bool userSkipDmg;
+
+  Movie();
+
+  void record(bool powerOn);
+  bool play();
+  void stop();
+  void nextFrame();
+  size_t frameCount() const;
+  bool save(const QString &path) const;
+  bool load(const QString &path);
+};
@@ -8,39 +8,73 @@
 
 #include "ppu.h"
 
-#include <map>
+#include <algorithm>
+#include <cstring>
 
 #include "cgb.h"
 #include "memory.h"
+#include "renderer.h"
+#include "savestate.h"
 
 PPU::PPU()
     : cgb(nullptr),
-      screen(nullptr),
+      frameBuffer(nullptr),
       palette(nullptr),
       windowLineNum(0),
       visibleSprites{},
       visibleSpriteCount(0),
-      frameRendered(false),
+      colorTable(ColorTable::get(RAW_COLORS)),
       showBackground(true),
       showWindow(true),
       showSprites(true),
       statInt(false),
-      cycles(0),
-      renderedScx(),
-      renderedScy(),
-      scxs(),
-      scys() {}
+      skipFrame(false),
+      skippedFrames(0),
+      oamSprites(),
+      lineSpriteMasks(),
+      spriteLinesHeight(SPRITE_PX_HEIGHT_SHORT),
+      lineStates(),
+      deferredLines(),
+      deferredLineCount(0),
+      frameInFlight(false),
+      frameVram(),
+      frameCramBg(),
+      frameCramObj(),
+      frameDmgColors(),
+      frameColors(),
+      renderFromCopy(false),
+      frameRenderMode(RenderMode::INLINE),
+      workerPool(),
+      renderer(),
+      observer(nullptr),
+      observerCalls(0),
+      frameSkip(0),
+      autoFrameSkip(false),
+      hideFrames(false),
+      renderMode(RenderMode::INLINE),
+      dots(0),
+      lastClock(0) {}
+
+// defined here since renderer is incomplete in ppu.h
+PPU::~PPU() {}
 
 void PPU::step() {
-  cycles += cgb->doubleSpeedMode ? 0.5 : 1.0;
+  dots += cgb->masterClock - lastClock;
+  lastClock = cgb->masterClock;
 
   uint8 &ly = cgb->mem.getByte(LY);
   uint8 &stat = cgb->mem.getByte(STAT);
 
   if (lcdEnable() && !cgb->stop) {
     // if scanline completed, increment ly
-    if (cycles > SCANLINE_CYCLES) {
-      if (++ly >= SCREEN_LINES) ly = 0;
+    if (dots > SCANLINE_DOTS) {
+      if (++ly >= SCREEN_LINES) {
+        ly = 0;
+
+        // frame rendered in parallel at vblank must
+        // be presented before the next frame starts
+        if (frameInFlight) finishDeferredFrame();
+      }
 
       // check if current line number
       // is equal to the value in lyc
@@ -50,14 +84,14 @@ void PPU::step() {
         stat &= ~BIT2_MASK;
       }
 
-      cycles = fmod(cycles, SCANLINE_CYCLES);
+      dots %= SCANLINE_DOTS;
     }
 
     if (ly < SCREEN_PX_HEIGHT) {
       // **************************************************
       // OAM Search
       // **************************************************
-      if (cycles < OAM_SEARCH_CYCLES) {
+      if (dots < OAM_SEARCH_DOTS) {
         if (getMode() != OAM_SEARCH_MODE) {
           setMode(OAM_SEARCH_MODE);
           findVisibleSprites();
@@ -67,23 +101,35 @@ void PPU::step() {
       // **************************************************
       // Pixel Transfer
       // **************************************************
-      else if (cycles < PIXEL_TRANSFER_CYCLES) {
+      else if (dots < PIXEL_TRANSFER_DOTS) {
         if (getMode() != PIXEL_TRANSFER_MODE) {
           setMode(PIXEL_TRANSFER_MODE);
-          scanline_t scanline;
-          resetScanline(scanline);
-          if ((bgEnable() || !cgb->dmgMode) && showBackground)
-            renderBg(scanline);
-          if (windowEnable() && showWindow) renderWindow(scanline);
-          if (spriteEnable() && showSprites) renderSprites(scanline);
-          transferScanlineToScreen(scanline);
+          line_state_t &line = lineStates[ly];
+          captureLineState(line);
+
+          // skipped frames are never rendered, deferred
+          // frames are rendered in parallel at vblank and
+          // pipelined frames are drawn by the render thread
+          if (!frameHidden()) {
+            switch (frameRenderMode) {
+              case RenderMode::PARALLEL:
+                deferredLines[deferredLineCount++] = ly;
+                break;
+              case RenderMode::PIPELINED:
+                queueLine(line);
+                break;
+              default:
+                renderLine(line);
+                break;
+            }
+          }
         }
       }
 
       // **************************************************
       // H-Blank
       // **************************************************
-      else if (cycles < HBLANK_CYCLES) {
+      else if (dots < HBLANK_DOTS) {
         if (getMode() != HBLANK_MODE) {
           setMode(HBLANK_MODE);
         }
@@ -95,7 +141,22 @@ void PPU::step() {
       if (getMode() != VBLANK_MODE) {
         setMode(VBLANK_MODE);
         cgb->cpu.requestInterrupt(VBLANK_INT);
-        emit cgb->sendScreen(screen);
+        cgb->apu.endFrame();
+        ++cgb->frameNumber;
+        if (deferredLineCount > 0) {
+          renderDeferredLines();
+          frameInFlight = true;
+        } else if (!frameHidden() &&
+                   frameRenderMode == RenderMode::PIPELINED &&
+                   renderer) {
+          renderer->queueFrameEnd();
+        } else if (!frameHidden()) {
+          frameBuffer->publish();
+          emit cgb->sendScreen();
+        }
+        skipFrame = nextFrameSkipped();
+        if (renderMode != RenderMode::PIPELINED) flushRenderer();
+        frameRenderMode = renderMode;
         windowLineNum = 0;
       }
     }
@@ -106,15 +167,47 @@ void PPU::step() {
     stat &= ~THREE_BITS_MASK;
     windowLineNum = 0;
     statInt = false;
-    if (cycles > SCANLINE_CYCLES * SCREEN_LINES) {
-      screen->fill(cgb->cgbMode ? getPaletteColor(cgb->mem.cramBg, 0, 0)
-                                : palette->data[0]);
-      cycles = fmod(cycles, SCANLINE_CYCLES * SCREEN_LINES);
-      emit cgb->sendScreen(screen);
+    if (dots > SCANLINE_DOTS * SCREEN_LINES) {
+      syncDeferredRendering();
+      flushRenderer();
+      uint16 color = cgb->cgbMode ? getCramColor(cgb->mem.cramBg, 0, 0) : 0;
+      frameBuffer->back()->fill(toScreenColor(color));
+      fill_n(frameBuffer->backColors(), SCREEN_PX_WIDTH * SCREEN_PX_HEIGHT,
+             color);
+      dots %= SCANLINE_DOTS * SCREEN_LINES;
+      cgb->apu.endFrame();
+      ++cgb->frameNumber;
+      frameBuffer->publish();
+      emit cgb->sendScreen();
     }
   }
 }
 
+// **************************************************
+// **************************************************
+// Frame Skip Functions
+// **************************************************
+// **************************************************
+
+// decide whether the next frame should skip
+// rendering, timing, interrupts and oam search
+// still run as normal on skipped frames, frames
+// are never skipped while they are being hidden
+bool PPU::nextFrameSkipped() {
+  if (hideFrames) return false;
+  bool skip;
+  if (autoFrameSkip) {
+    skip = cgb->behindRealTime && skippedFrames < MAX_AUTO_FRAME_SKIP;
+  } else {
+    skip = skippedFrames < frameSkip;
+  }
+  skippedFrames = skip ? skippedFrames + 1 : 0;
+  return skip;
+}
+
+// frame is not drawn if it is skipped or hidden
+bool PPU::frameHidden() const { return skipFrame || hideFrames; }
+
 // **************************************************
 // **************************************************
 // OAM Search Functions
@@ -124,13 +217,14 @@ void PPU::step() {
 // find which sprites intersect the
 // current scanline
 void PPU::findVisibleSprites() {
+  // sprite lines depend on sprite height
+  if (spriteHeight() != spriteLinesHeight) refreshOam();
+
   visibleSpriteCount = 0;
-  uint8 ly = cgb->mem.getByte(LY);
-  for (uint8 oamIdx = 0; oamIdx < OAM_ENTRY_COUNT; oamIdx++) {
-    sprite_t oamEntry = getSpriteOAM(oamIdx);
-    if ((ly + SPRITE_PX_HEIGHT_TALL) >= oamEntry.y &&
-        (ly + SPRITE_PX_HEIGHT_TALL) < (oamEntry.y + spriteHeight())) {
-      visibleSprites[visibleSpriteCount] = oamEntry;
+  uint64 spriteMask = lineSpriteMasks[cgb->mem.getByte(LY)];
+  for (uint8 oamIdx = 0; spriteMask != 0; ++oamIdx, spriteMask >>= 1) {
+    if (spriteMask & 1) {
+      visibleSprites[visibleSpriteCount] = oamSprites[oamIdx];
       ++visibleSpriteCount;
 
       // stop once we have found 10 sprites
@@ -141,32 +235,264 @@ void PPU::findVisibleSprites() {
   }
 }
 
+// add or remove sprite from the masks of
+// the visible lines it intersects
+void PPU::setSpriteLines(uint8 spriteIdx, bool onLines) {
+  int startLine = oamSprites[spriteIdx].y - SPRITE_PX_HEIGHT_TALL;
+  int endLine = min(startLine + spriteLinesHeight, SCREEN_PX_HEIGHT);
+  uint64 spriteBit = 1ULL << spriteIdx;
+  for (int line = max(startLine, 0); line < endLine; ++line) {
+    if (onLines) {
+      lineSpriteMasks[line] |= spriteBit;
+    } else {
+      lineSpriteMasks[line] &= ~spriteBit;
+    }
+  }
+}
+
+// update sprite after a write to its oam entry
+void PPU::oamWritten(uint16 addr) {
+  uint8 spriteIdx = (addr - OAM_ADDR) / OAM_ENTRY_BYTES;
+  setSpriteLines(spriteIdx, false);
+  oamSprites[spriteIdx] = getSpriteOAM(spriteIdx);
+  setSpriteLines(spriteIdx, true);
+}
+
+// restart mode timing from the current master
+// clock, the lcd registers are reset by memory
+void PPU::reset() {
+  dots = 0;
+  lastClock = cgb->masterClock;
+  windowLineNum = 0;
+  visibleSpriteCount = 0;
+  statInt = false;
+  skipFrame = false;
+  skippedFrames = 0;
+  refreshOam();
+}
+
+// rebuild all sprites and sprite lines from oam,
+// needed after oam dma, reset or a change in
+// sprite height
+void PPU::refreshOam() {
+  spriteLinesHeight = spriteHeight();
+  fill_n(lineSpriteMasks, SCREEN_PX_HEIGHT, 0);
+  for (uint8 spriteIdx = 0; spriteIdx < OAM_ENTRY_COUNT; ++spriteIdx) {
+    oamSprites[spriteIdx] = getSpriteOAM(spriteIdx);
+    setSpriteLines(spriteIdx, true);
+  }
+}
+
+// save mode timing and the per line state that
+// carries between scanlines, rendering state is
+// not saved since the frame is synced first
+void PPU::saveState(StateWriter &state) const {
+  state.beginSection(PPU_SECTION);
+  state.write(dots);
+  state.write(lastClock);
+  state.write(windowLineNum);
+  state.write(visibleSprites);
+  state.write(visibleSpriteCount);
+  state.write(statInt);
+  state.write(skipFrame);
+  state.write(skippedFrames);
+  state.endSection();
+}
+
+// lines captured before the state was saved are
+// not available, so the rest of the frame is
+// rendered inline over the previous frame
+void PPU::loadState(StateReader &state) {
+  state.read(dots);
+  state.read(lastClock);
+  state.read(windowLineNum);
+  state.read(visibleSprites);
+  state.read(visibleSpriteCount);
+  state.read(statInt);
+  state.read(skipFrame);
+  state.read(skippedFrames);
+  visibleSpriteCount = min<uint8>(visibleSpriteCount, MAX_SPRITES_PER_LINE);
+  frameRenderMode = RenderMode::INLINE;
+  refreshOam();
+}
+
+// **************************************************
+// **************************************************
+// Parallel Rendering Functions
+// **************************************************
+// **************************************************
+
+// render all deferred scanlines on the worker
+// pool from a copy of vram and cram, the frame is
+// published once the workers finish (see
+// finishDeferredFrame)
+void PPU::renderDeferredLines() {
+  if (!workerPool) {
+    int threadCount = thread::hardware_concurrency() - 1;
+    workerPool = make_unique<WorkerPool>(max(threadCount, 1));
+  }
+  memcpy(frameVram, cgb->mem.vram, sizeof(frameVram));
+  memcpy(frameCramBg, cgb->mem.cramBg, sizeof(frameCramBg));
+  memcpy(frameCramObj, cgb->mem.cramObj, sizeof(frameCramObj));
+  memcpy(frameDmgColors, palette->data, sizeof(frameDmgColors));
+  frameColors = liveColors();
+  frameColors.cramBg = frameCramBg;
+  frameColors.cramObj = frameCramObj;
+  frameColors.dmgColors = frameDmgColors;
+  renderFromCopy = true;
+  workerPool->dispatch(deferredLineCount, [this](int lineIdx) {
+    renderLine(lineStates[deferredLines[lineIdx]]);
+  });
+}
+
+void PPU::waitDeferredLines() {
+  workerPool->wait();
+  renderFromCopy = false;
+  deferredLineCount = 0;
+}
+
+// wait for the frame being rendered in parallel
+// and send it to the screen
+void PPU::finishDeferredFrame() {
+  waitDeferredLines();
+  frameInFlight = false;
+  frameBuffer->publish();
+  emit cgb->sendScreen();
+}
+
+// finishes a frame still being rendered in parallel
+// and renders any scanlines captured so far in the
+// current frame, the rest of the current frame is
+// then rendered inline since it is no longer safe
+// to defer it to vblank
+void PPU::syncDeferredRendering() {
+  if (frameInFlight) {
+    finishDeferredFrame();
+  } else if (deferredLineCount > 0) {
+    renderDeferredLines();
+    waitDeferredLines();
+    frameRenderMode = RenderMode::INLINE;
+  }
+}
+
+// must be called before vram or cram is modified,
+// a frame rendered at vblank reads its own copy so
+// only scanlines still deferred in the current
+// frame have to be drawn first
+void PPU::displayMemoryWritten() {
+  if (!frameInFlight && deferredLineCount > 0) syncDeferredRendering();
+}
+
+// **************************************************
+// **************************************************
+// Pipelined Rendering Functions
+// **************************************************
+// **************************************************
+
+// compose indexed scanline and send it to the
+// render thread along with the palettes in use,
+// cram is copied since it may change before the
+// render thread converts the scanline
+void PPU::queueLine(const line_state_t &line) {
+  if (!renderer) renderer = make_unique<Renderer>(this);
+  queued_line_t *entry = renderer->nextLine();
+  composeLine(entry->scanline, line);
+  entry->line = line;
+  if (cgb->cgbMode) {
+    memcpy(entry->cramBg, cgb->mem.cramBg, sizeof(entry->cramBg));
+    memcpy(entry->cramObj, cgb->mem.cramObj, sizeof(entry->cramObj));
+  }
+  memcpy(entry->dmgColors, palette->data, sizeof(entry->dmgColors));
+  entry->colorTable = colorTable;
+  entry->dmgMode = cgb->dmgMode;
+  entry->cgbMode = cgb->cgbMode;
+  renderer->queueLine();
+}
+
+// wait for the render thread to draw every
+// queued scanline, the frame buffer is only
+// drawn into by the render thread until then
+void PPU::flushRenderer() {
+  if (renderer) renderer->flush();
+}
+
 // **************************************************
 // **************************************************
 // Rendering Functions
 // **************************************************
 // **************************************************
 
-// render background tile rows that
-// intersect current scanline
-void PPU::renderBg(scanline_t &scanline) {
-  uint16 tileMapAddr = bgMapAddr();
-  uint16 tileDataAddr = bgWindowDataAddr();
+// palettes and modes as they are now, used by
+// scanlines drawn on the emulation thread
+line_colors_t PPU::liveColors() const {
+  return {cgb->mem.cramBg, cgb->mem.cramObj, palette->data, colorTable,
+          cgb->dmgMode, cgb->cgbMode};
+}
 
-  uint8 ly = cgb->mem.getByte(LY);
-  uint8 scx = cgb->mem.getByte(SCX);
-  uint8 scy = cgb->mem.getByte(SCY);
+// capture lcd registers and visible sprites for
+// the current scanline and advance the window
+// line counter
+void PPU::captureLineState(line_state_t &line) {
+  line.ly = cgb->mem.getByte(LY);
+  line.lcdc = cgb->mem.getByte(LCDC);
+  line.scx = cgb->mem.getByte(SCX);
+  line.scy = cgb->mem.getByte(SCY);
+  line.wx = cgb->mem.getByte(WX);
+  line.wy = cgb->mem.getByte(WY);
+  line.bgp = cgb->mem.getByte(BGP);
+  line.obp0 = cgb->mem.getByte(OBP0);
+  line.obp1 = cgb->mem.getByte(OBP1);
+  line.windowLineNum = windowLineNum;
+  line.spriteCount = visibleSpriteCount;
+  for (int i = 0; i < visibleSpriteCount; ++i) {
+    line.sprites[i] = visibleSprites[i];
+  }
 
-  // record scx and scy
-  scxs[ly] = scx;
-  scys[ly] = scy;
+  // window line counter only advances
+  // on lines where the window is drawn
+  if (windowEnable(line.lcdc) && showWindow && line.ly >= line.wy) {
+    ++windowLineNum;
+  }
+
+  // count the call before loading the observer
+  // so detach can wait for it to finish
+  ++observerCalls;
+  PPUObserver *ppuObserver = observer.load();
+  if (ppuObserver) ppuObserver->lineCaptured(line);
+  --observerCalls;
+}
+
+// render scanline using the captured lcd state
+// and transfer it to the screen
+void PPU::renderLine(const line_state_t &line) {
+  scanline_t scanline;
+  composeLine(scanline, line);
+  transferScanlineToScreen(scanline, line,
+                           renderFromCopy ? frameColors : liveColors());
+}
+
+// compose background, window and sprite
+// layers into an indexed scanline
+void PPU::composeLine(scanline_t &scanline, const line_state_t &line) {
+  resetScanline(scanline);
+  if ((bgEnable(line.lcdc) || !cgb->dmgMode) && showBackground)
+    renderBg(scanline, line);
+  if (windowEnable(line.lcdc) && showWindow) renderWindow(scanline, line);
+  if (spriteEnable(line.lcdc) && showSprites) renderSprites(scanline, line);
+}
+
+// render background tile rows that
+// intersect current scanline
+void PPU::renderBg(scanline_t &scanline, const line_state_t &line) {
+  uint16 tileMapAddr = bgMapAddr(line.lcdc);
+  uint16 tileDataAddr = bgWindowDataAddr(line.lcdc);
 
   // render background row
   uint8 pxCount = 0;
-  uint8 pxY = scy + ly;
+  uint8 pxY = line.scy + line.ly;
   while (pxCount < SCREEN_PX_WIDTH) {
     // get background tile number (0 to 1023)
-    uint8 pxX = scx + pxCount;
+    uint8 pxX = line.scx + pxCount;
     uint8 bgTileX = pxX / TILE_PX_DIM;
     uint8 bgTileY = pxY / TILE_PX_DIM;
     uint8 innerBgTileX = pxX % TILE_PX_DIM;
@@ -174,7 +500,7 @@ void PPU::renderBg(scanline_t &scanline) {
     uint16 bgTileNo = bgTileY * BG_TILE_DIM + bgTileX;
 
     // get data tile number (0 to 256 or -128 to 127)
-    uint8 tileNo = cgb->mem.getVramByte(tileMapAddr + bgTileNo, false);
+    uint8 tileNo = vramByte(tileMapAddr + bgTileNo, false);
 
     TileRow row;
     tile_map_attr_t attr;
@@ -189,7 +515,7 @@ void PPU::renderBg(scanline_t &scanline) {
     // cgb get row of tile pixels
     else {
       attr = getTileMapAttr(tileMapAddr, bgTileNo);
-      row = getTileRow(attr, tileNo, innerBgTileY);
+      row = getTileRow(attr, tileDataAddr, tileNo, innerBgTileY);
     }
 
     // transfer pixel row to scanline
@@ -206,25 +532,22 @@ void PPU::renderBg(scanline_t &scanline) {
       ++pxCount;
     }
   }
-
-  if (ly == 143) renderedScx = getMostFreqScx();
-  if (ly == 143) renderedScy = getMostFreqScy();
 }
 
 // render window tile rows that
 // intersect the current scanline
-void PPU::renderWindow(scanline_t &scanline) {
-  if (cgb->mem.getByte(LY) >= cgb->mem.getByte(WY)) {
-    uint16 tileMapAddr = windowMapAddr();
-    uint16 tileDataAddr = bgWindowDataAddr();
+void PPU::renderWindow(scanline_t &scanline, const line_state_t &line) {
+  if (line.ly >= line.wy) {
+    uint16 tileMapAddr = windowMapAddr(line.lcdc);
+    uint16 tileDataAddr = bgWindowDataAddr(line.lcdc);
 
     uint8 pxCount = 0;
-    uint8 winX = cgb->mem.getByte(WX) - 7;
+    uint8 winX = line.wx - 7;
     while (pxCount + winX < SCREEN_PX_WIDTH) {
       uint8 winTileX = pxCount / TILE_PX_DIM;
-      uint8 winTileY = windowLineNum / TILE_PX_DIM;
+      uint8 winTileY = line.windowLineNum / TILE_PX_DIM;
       uint16 winTileNo = winTileY * BG_TILE_DIM + winTileX;
-      uint8 tileNo = cgb->mem.getVramByte(tileMapAddr + winTileNo, false);
+      uint8 tileNo = vramByte(tileMapAddr + winTileNo, false);
 
       TileRow row;
       tile_map_attr_t attr;
@@ -233,13 +556,13 @@ void PPU::renderWindow(scanline_t &scanline) {
 
       // dmg get tile row of pixels
       if (cgb->dmgMode) {
-        row = getTileRow(tileDataAddr, tileNo, windowLineNum % 8);
+        row = getTileRow(tileDataAddr, tileNo, line.windowLineNum % 8);
       }
 
       // cgb get tile row of tile pixels
       else {
         attr = getTileMapAttr(tileMapAddr, winTileNo);
-        row = getTileRow(attr, tileNo, windowLineNum % 8);
+        row = getTileRow(attr, tileDataAddr, tileNo, line.windowLineNum % 8);
       }
 
       // transfer pixel row to scanline
@@ -255,24 +578,23 @@ void PPU::renderWindow(scanline_t &scanline) {
         if (++pxCount + winX >= SCREEN_PX_WIDTH) break;
       }
     }
-
-    ++windowLineNum;
   }
 }
 
 // render sprite tile rows that
 // intersect the current scanline
-void PPU::renderSprites(scanline_t &scanline) {
-  for (int spriteIdx = 0; spriteIdx < visibleSpriteCount; ++spriteIdx) {
-    sprite_t sprite = visibleSprites[spriteIdx];
-    uint8 spriteRow = (cgb->mem.getByte(LY) + 16) - sprite.y;
-    TileRow row = getSpriteRow(sprite, spriteRow);
+void PPU::renderSprites(scanline_t &scanline, const line_state_t &line) {
+  uint8 height = spriteHeight(line.lcdc);
+  for (int spriteIdx = 0; spriteIdx < line.spriteCount; ++spriteIdx) {
+    const sprite_t &sprite = line.sprites[spriteIdx];
+    uint8 spriteRow = (line.ly + 16) - sprite.y;
+    TileRow row = getSpriteRow(sprite, spriteRow, height);
 
     // draw sprite row onto screen
     for (int rowIdx = 0; rowIdx < TILE_PX_DIM; ++rowIdx) {
       int pxX = sprite.x + rowIdx - 8;
       if (pxX >= 0 && pxX < SCREEN_PX_WIDTH) {
-        if (spriteHasPriority(sprite, scanline, pxX, row[rowIdx])) {
+        if (spriteHasPriority(sprite, scanline, line, pxX, row[rowIdx])) {
           scanline.pixels[pxX] = row[rowIdx];
           scanline.paletteTypes[pxX] =
               sprite.palette ? PaletteType::SPRITE1 : PaletteType::SPRITE0;
@@ -289,13 +611,14 @@ void PPU::renderSprites(scanline_t &scanline) {
 
 // check sprite/background priority to determine if
 // sprite pixel should be rendered
-bool PPU::spriteHasPriority(sprite_t &sprite, scanline_t &scanline,
-                            uint8 scanlineIdx, uint8 px) {
+bool PPU::spriteHasPriority(const sprite_t &sprite, scanline_t &scanline,
+                            const line_state_t &line, uint8 scanlineIdx,
+                            uint8 px) {
   // if another sprite is located at the current pixel,
   // draw current sprite if it has a lower x value
   if (scanline.paletteTypes[scanlineIdx] == PaletteType::SPRITE0 ||
       scanline.paletteTypes[scanlineIdx] == PaletteType::SPRITE1) {
-    auto otherSprite = visibleSprites[scanline.spriteIndices[scanlineIdx]];
+    auto otherSprite = line.sprites[scanline.spriteIndices[scanlineIdx]];
     return sprite.x < otherSprite.x && px != 0;
   }
 
@@ -309,7 +632,7 @@ bool PPU::spriteHasPriority(sprite_t &sprite, scanline_t &scanline,
 
   // cgb background/sprite priority
   else {
-    return (!bgEnable() ||
+    return (!bgEnable(line.lcdc) ||
             (!scanline.priorities[scanlineIdx] && !sprite.priority) ||
             scanline.pixels[scanlineIdx] == 0) &&
            px != 0;
@@ -317,26 +640,31 @@ bool PPU::spriteHasPriority(sprite_t &sprite, scanline_t &scanline,
 }
 
 // apply palette colors to current pixel
-// values in the screen buffer
-void PPU::transferScanlineToScreen(scanline_t &scanline) {
+// values in the screen buffer, called from
+// the render thread when pipelined
+void PPU::transferScanlineToScreen(const scanline_t &scanline,
+                                   const line_state_t &line,
+                                   const line_colors_t &colors) {
+  uint *screenLine = (uint *)frameBuffer->back()->scanLine(line.ly);
+  uint16 *lineColors = frameBuffer->backColors() + line.ly * SCREEN_PX_WIDTH;
   for (int px = 0; px < SCREEN_PX_WIDTH; ++px) {
     auto palType = scanline.paletteTypes[px];
-    uint pxColor;
+    uint16 pxColor;
 
     // dmg palette
-    if (cgb->dmgMode) {
+    if (colors.dmgMode) {
       // use game boy color palettes when using
       // game boy color in dmg mode
-      if (cgb->cgbMode) {
+      if (colors.cgbMode) {
         switch (palType) {
           case PaletteType::BG:
-            pxColor = getPaletteColor(cgb->mem.cramBg, 0, scanline.pixels[px]);
+            pxColor = getCramColor(colors.cramBg, 0, scanline.pixels[px]);
             break;
           case PaletteType::SPRITE0:
-            pxColor = getPaletteColor(cgb->mem.cramObj, 0, scanline.pixels[px]);
+            pxColor = getCramColor(colors.cramObj, 0, scanline.pixels[px]);
             break;
           case PaletteType::SPRITE1:
-            pxColor = getPaletteColor(cgb->mem.cramObj, 1, scanline.pixels[px]);
+            pxColor = getCramColor(colors.cramObj, 1, scanline.pixels[px]);
             break;
         }
       }
@@ -347,27 +675,28 @@ void PPU::transferScanlineToScreen(scanline_t &scanline) {
         uint8 pal;
         switch (palType) {
           case PaletteType::BG:
-            pal = cgb->mem.getByte(BGP);
+            pal = line.bgp;
             break;
           case PaletteType::SPRITE0:
-            pal = cgb->mem.getByte(OBP0);
+            pal = line.obp0;
             break;
           case PaletteType::SPRITE1:
-            pal = cgb->mem.getByte(OBP1);
+            pal = line.obp1;
             break;
         }
-        pxColor = getPaletteColor(pal, scanline.pixels[px]);
+        pxColor = (pal >> (2 * scanline.pixels[px])) & TWO_BITS_MASK;
       }
     }
 
     // cgb palette
     else {
       uint8 palIdx = scanline.paletteIndices[px];
-      uint8 *cram =
-          palType == PaletteType::BG ? cgb->mem.cramBg : cgb->mem.cramObj;
-      pxColor = getPaletteColor(cram, palIdx, scanline.pixels[px]);
+      const uint8 *cram =
+          palType == PaletteType::BG ? colors.cramBg : colors.cramObj;
+      pxColor = getCramColor(cram, palIdx, scanline.pixels[px]);
     }
-    screen->setPixel(px, cgb->mem.getByte(LY), pxColor);
+    lineColors[px] = pxColor;
+    screenLine[px] = toScreenColor(pxColor, colors);
   }
 }
 
@@ -388,6 +717,13 @@ void PPU::resetScanline(scanline_t &scanline) {
 // **************************************************
 // **************************************************
 
+// vram byte in the given bank, read from the
+// copy while deferred scanlines are rendering
+uint8 PPU::vramByte(uint16 addr, bool bank) const {
+  const uint8 *vram = renderFromCopy ? frameVram : cgb->mem.vram;
+  return vram[addr - VRAM_ADDR + (bank ? RAM_BANK_BYTES : 0)];
+}
+
 // get specified row of the given tile
 TileRow PPU::getTileRow(uint16 baseAddr, uint8 tileNo, uint8 row,
                         bool vramBank) const {
@@ -395,8 +731,8 @@ TileRow PPU::getTileRow(uint16 baseAddr, uint8 tileNo, uint8 row,
   int16 tileNoSigned = baseAddr == TILE_DATA_ADDR_0 ? (int8)tileNo : tileNo;
   uint16 tileAddr = baseAddr + tileNoSigned * TILE_BYTES;
   uint16 tileRowAddr = tileAddr + 2 * row;
-  uint8 rowDataLo = cgb->mem.getVramByte(tileRowAddr, vramBank);
-  uint8 rowDataHi = cgb->mem.getVramByte(tileRowAddr + 1, vramBank);
+  uint8 rowDataLo = vramByte(tileRowAddr, vramBank);
+  uint8 rowDataHi = vramByte(tileRowAddr + 1, vramBank);
 
   // convert tile row data into pixel values
   // rowDataLo = abcdefgh
@@ -414,16 +750,22 @@ TileRow PPU::getTileRow(uint16 baseAddr, uint8 tileNo, uint8 row,
 // get specified row of the given background
 // or window tile (cgb only)
 TileRow PPU::getTileRow(tile_map_attr_t attr, uint8 tileNo, uint8 row) const {
+  return getTileRow(attr, bgWindowDataAddr(), tileNo, row);
+}
+
+// get specified row of the given background or
+// window tile using the given tile data address
+// (cgb only)
+TileRow PPU::getTileRow(tile_map_attr_t attr, uint16 dataAddr, uint8 tileNo,
+                        uint8 row) const {
   row = attr.flipY ? TILE_PX_DIM - row - 1 : row;
-  TileRow tileRow =
-      getTileRow(bgWindowDataAddr(), tileNo, row, attr.vramBankNum);
+  TileRow tileRow = getTileRow(dataAddr, tileNo, row, attr.vramBankNum);
   if (attr.flipX) flipTileRow(tileRow);
   return tileRow;
 }
 
 // get specified row of given sprite
-TileRow PPU::getSpriteRow(sprite_t oamEntry, uint8 row) const {
-  uint8 height = spriteHeight();
+TileRow PPU::getSpriteRow(sprite_t oamEntry, uint8 row, uint8 height) const {
   row = oamEntry.flipY ? height - row - 1 : row;
   uint8 pattern = height == SPRITE_PX_HEIGHT_TALL
                       ? oamEntry.pattern & ~BIT0_MASK
@@ -462,7 +804,7 @@ sprite_t PPU::getSpriteOAM(uint8 spriteIdx) const {
 // the background map (cgb only)
 tile_map_attr_t PPU::getTileMapAttr(uint16 baseAddr, uint16 bgWinTileNo) const {
   tile_map_attr_t attr;
-  uint8 attrByte = cgb->mem.getVramByte(baseAddr + bgWinTileNo, true);
+  uint8 attrByte = vramByte(baseAddr + bgWinTileNo, true);
   attr.priority = attrByte & BIT7_MASK;
   attr.flipY = attrByte & BIT6_MASK;
   attr.flipX = attrByte & BIT5_MASK;
@@ -491,31 +833,45 @@ void PPU::flipTileRow(TileRow &row) const {
 
 bool PPU::lcdEnable() const { return cgb->mem.getByte(LCDC) & BIT7_MASK; }
 
-bool PPU::bgEnable() const { return (cgb->mem.getByte(LCDC) & BIT0_MASK); }
+uint8 PPU::spriteHeight() const {
+  return spriteHeight(cgb->mem.getByte(LCDC));
+}
+
+uint16 PPU::windowMapAddr() const {
+  return windowMapAddr(cgb->mem.getByte(LCDC));
+}
 
-bool PPU::windowEnable() const {
-  return (cgb->mem.getByte(LCDC) & BIT0_MASK) &&
-         (cgb->mem.getByte(LCDC) & BIT5_MASK);
+uint16 PPU::bgWindowDataAddr() const {
+  return bgWindowDataAddr(cgb->mem.getByte(LCDC));
 }
 
-bool PPU::spriteEnable() const { return (cgb->mem.getByte(LCDC) & BIT1_MASK); }
+uint16 PPU::bgMapAddr() const { return bgMapAddr(cgb->mem.getByte(LCDC)); }
 
-uint8 PPU::spriteHeight() const {
-  return cgb->mem.getByte(LCDC) & BIT2_MASK ? SPRITE_PX_HEIGHT_TALL
-                                            : SPRITE_PX_HEIGHT_SHORT;
+// the following functions decode a captured
+// lcdc value rather than the current register
+
+bool PPU::bgEnable(uint8 lcdc) const { return lcdc & BIT0_MASK; }
+
+bool PPU::windowEnable(uint8 lcdc) const {
+  return (lcdc & BIT0_MASK) && (lcdc & BIT5_MASK);
 }
 
-uint16 PPU::windowMapAddr() const {
-  return cgb->mem.getByte(LCDC) & BIT6_MASK ? TILE_MAP_ADDR_1 : TILE_MAP_ADDR_0;
+bool PPU::spriteEnable(uint8 lcdc) const { return lcdc & BIT1_MASK; }
+
+uint8 PPU::spriteHeight(uint8 lcdc) const {
+  return lcdc & BIT2_MASK ? SPRITE_PX_HEIGHT_TALL : SPRITE_PX_HEIGHT_SHORT;
 }
 
-uint16 PPU::bgWindowDataAddr() const {
-  return cgb->mem.getByte(LCDC) & BIT4_MASK ? TILE_DATA_ADDR_1
-                                            : TILE_DATA_ADDR_0;
+uint16 PPU::windowMapAddr(uint8 lcdc) const {
+  return lcdc & BIT6_MASK ? TILE_MAP_ADDR_1 : TILE_MAP_ADDR_0;
+}
+
+uint16 PPU::bgWindowDataAddr(uint8 lcdc) const {
+  return lcdc & BIT4_MASK ? TILE_DATA_ADDR_1 : TILE_DATA_ADDR_0;
 }
 
-uint16 PPU::bgMapAddr() const {
-  return cgb->mem.getByte(LCDC) & BIT3_MASK ? TILE_MAP_ADDR_1 : TILE_MAP_ADDR_0;
+uint16 PPU::bgMapAddr(uint8 lcdc) const {
+  return lcdc & BIT3_MASK ? TILE_MAP_ADDR_1 : TILE_MAP_ADDR_0;
 }
 
 // **************************************************
@@ -593,61 +949,56 @@ uint PPU::getPaletteColor(uint8 palette, uint8 colorIdx) const {
 }
 
 uint PPU::getPaletteColor(uint8 *cram, uint8 palIdx, uint8 colorIdx) const {
-  // get color of palette
+  return toScreenColor(getCramColor(cram, palIdx, colorIdx));
+}
+
+// get 15-bit color of palette in cram,
+// flagged to tell it apart from dmg shades
+uint16 PPU::getCramColor(const uint8 *cram, uint8 palIdx,
+                          uint8 colorIdx) const {
   uint8 cramAddr = palIdx * PAL_BYTES + colorIdx * 2;
   uint16 color = cram[cramAddr + 1] << 8 | cram[cramAddr];
-
-  // get color channels
-  uint8 red = color & FIVE_BITS_MASK;
-  uint8 green = (color >> 5) & FIVE_BITS_MASK;
-  uint8 blue = (color >> 10) & FIVE_BITS_MASK;
-
-  // convert to 32-bit argb color
-  return qRgb(red * 8, green * 8, blue * 8);
+  return (color & (COLOR_TABLE_SIZE - 1)) | CGB_COLOR_FLAG;
 }
 
-uint8 PPU::getMostFreqScx() {
-  map<uint8, uint8> freqs{};
-  for (uint8 x : scxs) {
-    if (freqs.find(x) == freqs.end()) {
-      freqs[x] = 1;
-    } else {
-      ++freqs[x];
-    }
-  }
+// convert dmg shade or flagged cgb color
+// to 32-bit argb color
+uint PPU::toScreenColor(uint16 color) const {
+  if (color & CGB_COLOR_FLAG) return colorTable[color & ~CGB_COLOR_FLAG];
+  return palette->data[color];
+}
 
-  uint mostFreqScx = 0;
-  uint8 maxFreq = 0;
-  for (auto pair : freqs) {
-    if (pair.second > maxFreq) {
-      maxFreq = pair.second;
-      mostFreqScx = pair.first;
-    }
+uint PPU::toScreenColor(uint16 color, const line_colors_t &colors) const {
+  if (color & CGB_COLOR_FLAG) {
+    return colors.colorTable[color & ~CGB_COLOR_FLAG];
   }
-
-  return mostFreqScx;
+  return colors.dmgColors[color];
 }
 
-uint8 PPU::getMostFreqScy() {
-  map<uint8, uint8> freqs{};
-  for (uint8 y : scys) {
-    if (freqs.find(y) == freqs.end()) {
-      freqs[y] = 1;
-    } else {
-      ++freqs[y];
+// recolor a completed frame from the colors kept
+// alongside it, used to show palette and color
+// correction changes without rendering again
+void PPU::recolorFrame(QImage *frame, const uint16 *colors) const {
+  for (int y = 0; y < SCREEN_PX_HEIGHT; ++y) {
+    uint *frameLine = (uint *)frame->scanLine(y);
+    const uint16 *lineColors = colors + y * SCREEN_PX_WIDTH;
+    for (int px = 0; px < SCREEN_PX_WIDTH; ++px) {
+      frameLine[px] = toScreenColor(lineColors[px]);
     }
   }
+}
 
-  uint mostFreqScy = 0;
-  uint8 maxFreq = 0;
-  for (auto pair : freqs) {
-    if (pair.second > maxFreq) {
-      maxFreq = pair.second;
-      mostFreqScy = pair.first;
-    }
-  }
+// attach debug observer, replaces any
+// observer that is already attached
+void PPU::attachObserver(PPUObserver *ppuObserver) {
+  observer.store(ppuObserver, memory_order_release);
+}
 
-  return mostFreqScy;
+// detach debug observer and wait for any
+// callback still running on the emulation thread
+void PPU::detachObserver() {
+  observer.store(nullptr);
+  while (observerCalls.load() > 0) this_thread::yield();
 }
 
 // **************************************************
@@ -664,3 +1015,12 @@ void PPU::toggleWindow(bool show) { showWindow = show; }
 
 // toggle sprite display layer
 void PPU::toggleSprites(bool show) { showSprites = show; }
+
+// set how scanlines are rendered,
+// takes effect on the next frame
+void PPU::setRenderMode(RenderMode mode) { renderMode = mode; }
+
+// set color correction applied to cgb colors
+void PPU::setColorProfile(ColorProfile profile) {
+  colorTable = ColorTable::get(profile);
+}
@@ -10,16 +10,23 @@
 
 #include <QImage>
 #include <array>
+#include <atomic>
+#include <memory>
 #include <thread>
 
 #include "../ui/palettes.h"
+#include "colortable.h"
+#include "framebuffer.h"
+#include "memory.h"
 #include "types.h"
+#include "workerpool.h"
 
-// cycles constants
-#define OAM_SEARCH_CYCLES 20
-#define PIXEL_TRANSFER_CYCLES OAM_SEARCH_CYCLES + 43
-#define HBLANK_CYCLES PIXEL_TRANSFER_CYCLES + 51
-#define SCANLINE_CYCLES 114
+// dot constants, one dot is one t-cycle
+// at normal speed
+#define OAM_SEARCH_DOTS 80
+#define PIXEL_TRANSFER_DOTS OAM_SEARCH_DOTS + 172
+#define HBLANK_DOTS PIXEL_TRANSFER_DOTS + 204
+#define SCANLINE_DOTS 456
 
 // px constants
 #define BG_PX_DIM 256
@@ -39,6 +46,7 @@
 #define BG_TILE_COUNT 32 * 32
 #define OAM_ENTRY_COUNT 40
 #define MAX_SPRITES_PER_LINE 10
+#define MAX_AUTO_FRAME_SKIP 4
 
 // screen modes
 #define HBLANK_MODE 0b00
@@ -52,6 +60,10 @@
 #define TILE_DATA_ADDR_0 0x9000
 #define TILE_DATA_ADDR_1 0x8000
 
+// set in frame colors holding a 15-bit cgb
+// color rather than a dmg shade
+#define CGB_COLOR_FLAG 0x8000
+
 using namespace std;
 
 // sprite oam entry
@@ -78,7 +90,13 @@ typedef struct {
   uint8 paletteNum;
 } tile_map_attr_t;
 
-enum PaletteType { BG, SPRITE0, SPRITE1 };
+enum PaletteType : uint8 { BG, SPRITE0, SPRITE1 };
+
+// inline renders each scanline during pixel
+// transfer, parallel renders whole frames on a
+// worker pool at vblank, pipelined hands indexed
+// scanlines to a separate render thread
+enum RenderMode : uint8 { INLINE, PARALLEL, PIPELINED };
 
 typedef struct {
   uint8 pixels[SCREEN_PX_WIDTH];
@@ -88,10 +106,47 @@ typedef struct {
   bool priorities[SCREEN_PX_WIDTH];       // cgb only
 } scanline_t;
 
+// lcd register state captured when a scanline
+// enters pixel transfer, used to render the
+// scanline either immediately or at vblank
+typedef struct {
+  uint8 ly;
+  uint8 lcdc;
+  uint8 scx, scy;
+  uint8 wx, wy;
+  uint8 bgp, obp0, obp1;
+  uint8 windowLineNum;
+  sprite_t sprites[MAX_SPRITES_PER_LINE];
+  uint8 spriteCount;
+} line_state_t;
+
+// palettes and modes used to convert a composed
+// scanline to screen colors, lines drawn off the
+// emulation thread point at copies taken when the
+// line was captured
+typedef struct {
+  const uint8 *cramBg, *cramObj;
+  const uint *dmgColors;
+  const uint *colorTable;
+  bool dmgMode, cgbMode;
+} line_colors_t;
+
+// debug observer notified on the emulation thread
+// each time the ppu captures a scanline, only used
+// while a debug window is attached
+class PPUObserver {
+ public:
+  virtual ~PPUObserver() {}
+  virtual void lineCaptured(const line_state_t &line) = 0;
+};
+
 // tile row of eight pixels
 using TileRow = array<uint8, TILE_PX_DIM>;
 
 class CGB;
+class Renderer;
+class StateReader;
+class StateWriter;
 
 class PPU : public QObject {
   Q_OBJECT
@@ -101,30 +156,84 @@ class PPU : public QObject {
   sprite_t visibleSprites[MAX_SPRITES_PER_LINE];
   uint8 visibleSpriteCount;
   bool statInt;
+  bool skipFrame;
+  uint8 skippedFrames;
+
+  // sprite line state, bit n of a line's
+  // mask is set if oam entry n is on it
+  sprite_t oamSprites[OAM_ENTRY_COUNT];
+  uint64 lineSpriteMasks[SCREEN_PX_HEIGHT];
+  uint8 spriteLinesHeight;
+
+  // parallel rendering state
+  line_state_t lineStates[SCREEN_PX_HEIGHT];
+  uint8 deferredLines[SCREEN_PX_HEIGHT];
+  uint8 deferredLineCount;
+  bool frameInFlight;
+
+  // copy of vram and cram read by the deferred
+  // scanlines while they render, so the game can
+  // write either during vblank without waiting
+  uint8 frameVram[RAM_BANK_BYTES * VRAM_BANKS];
+  uint8 frameCramBg[PAL_COUNT * PAL_BYTES];
+  uint8 frameCramObj[PAL_COUNT * PAL_BYTES];
+  uint frameDmgColors[PALETTE_COLOR_COUNT];
+  line_colors_t frameColors;
+  bool renderFromCopy;
+  RenderMode frameRenderMode;
+  unique_ptr<WorkerPool> workerPool;
+  unique_ptr<Renderer> renderer;
+
+  // attached debug observer and the number
+  // of callbacks currently running on it
+  atomic<PPUObserver *> observer;
+  atomic<int> observerCalls;
+
+  // frame skip functions
+  bool nextFrameSkipped();
+  bool frameHidden() const;
 
   // OAM search functions
   void findVisibleSprites();
+  void setSpriteLines(uint8 spriteIdx, bool onLines);
+
+  // parallel rendering functions
+  void renderDeferredLines();
+  void waitDeferredLines();
+  void finishDeferredFrame();
+
+  // pipelined rendering functions
+  void queueLine(const line_state_t &line);
 
   // rendering functions
-  void renderBg(scanline_t &scanline);
-  void renderWindow(scanline_t &scanline);
-  void renderSprites(scanline_t &scanline);
-  bool spriteHasPriority(sprite_t &sprite, scanline_t &scanline,
-                         uint8 scanlineIdx, uint8 px);
-  void transferScanlineToScreen(scanline_t &scanline);
+  line_colors_t liveColors() const;
+  void captureLineState(line_state_t &line);
+  void renderLine(const line_state_t &line);
+  void composeLine(scanline_t &scanline, const line_state_t &line);
+  void renderBg(scanline_t &scanline, const line_state_t &line);
+  void renderWindow(scanline_t &scanline, const line_state_t &line);
+  void renderSprites(scanline_t &scanline, const line_state_t &line);
+  bool spriteHasPriority(const sprite_t &sprite, scanline_t &scanline,
+                         const line_state_t &line, uint8 scanlineIdx,
+                         uint8 px);
   void resetScanline(scanline_t &scanline);
 
   // read display memory functions
-  TileRow getSpriteRow(sprite_t oamEntry, uint8 row) const;
+  uint8 vramByte(uint16 addr, bool bank) const;
+  TileRow getSpriteRow(sprite_t oamEntry, uint8 row, uint8 height) const;
   sprite_t getSpriteOAM(uint8 spriteIdx) const;
   void flipTileRow(TileRow &row) const;
 
   // lcdc register functions
   bool lcdEnable() const;
-  bool bgEnable() const;
-  bool windowEnable() const;
-  bool spriteEnable() const;
   uint8 spriteHeight() const;
+  bool bgEnable(uint8 lcdc) const;
+  bool windowEnable(uint8 lcdc) const;
+  bool spriteEnable(uint8 lcdc) const;
+  uint8 spriteHeight(uint8 lcdc) const;
+  uint16 bgMapAddr(uint8 lcdc) const;
+  uint16 windowMapAddr(uint8 lcdc) const;
+  uint16 bgWindowDataAddr(uint8 lcdc) const;
 
   // stat register functions
   bool coincidenceIntEnabled() const;
@@ -138,21 +247,41 @@ class PPU : public QObject {
 
  public:
   CGB *cgb;
-  QImage *screen;
-  bool frameRendered;
+  FrameBuffer *frameBuffer;
   Palette *palette;
+  const uint *colorTable;
   bool showBackground, showWindow, showSprites;
-  float cycles;
-  uint8 renderedScx, renderedScy;
-  uint8 scxs[SCREEN_PX_HEIGHT], scys[SCREEN_PX_HEIGHT];
+  uint8 frameSkip;
+  bool autoFrameSkip;
+
+  // hidden frames are emulated but not drawn,
+  // unlike frame skip this applies immediately
+  bool hideFrames;
+  RenderMode renderMode;
+  uint32 dots;
+  uint64 lastClock;
 
   PPU();
+  ~PPU();
 
   void step();
+  void reset();
+  void syncDeferredRendering();
+  void displayMemoryWritten();
+  void oamWritten(uint16 addr);
+  void refreshOam();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
+  void flushRenderer();
+  void transferScanlineToScreen(const scanline_t &scanline,
+                                const line_state_t &line,
+                                const line_colors_t &colors);
 
   TileRow getTileRow(uint16 baseAddr, uint8 tileNo, uint8 row,
                      bool vramBank = false) const;
   TileRow getTileRow(tile_map_attr_t attr, uint8 tileNo, uint8 row) const;
+  TileRow getTileRow(tile_map_attr_t attr, uint16 dataAddr, uint8 tileNo,
+                     uint8 row) const;
   tile_map_attr_t getTileMapAttr(uint16 baseAddr, uint16 bgWinTileNo) const;
 
   uint16 bgMapAddr() const;
@@ -161,12 +290,18 @@ class PPU : public QObject {
 
   uint getPaletteColor(uint8 palette, uint8 colorIdx) const;
   uint getPaletteColor(uint8 *cram, uint8 palIdx, uint8 colorIdx) const;
+  uint16 getCramColor(const uint8 *cram, uint8 palIdx, uint8 colorIdx) const;
+  uint toScreenColor(uint16 color) const;
+  uint toScreenColor(uint16 color, const line_colors_t &colors) const;
+  void recolorFrame(QImage *frame, const uint16 *colors) const;
 
-  uint8 getMostFreqScx();
-  uint8 getMostFreqScy();
+  void attachObserver(PPUObserver *ppuObserver);
+  void detachObserver();
 
  public slots:
   void toggleBackground(bool show);
   void toggleWindow(bool show);
   void toggleSprites(bool show);
+  void setRenderMode(RenderMode mode);
+  void setColorProfile(ColorProfile profile);
 };
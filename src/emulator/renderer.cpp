@@ -0,0 +1,97 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Renderer (Pipelined Render Thread)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "renderer.h"
+
+#include "cgb.h"
+
+Renderer::Renderer(PPU *ppu)
+    : ppu(ppu), queue(), renderThread(), running(true) {
+  renderThread = thread(&Renderer::render, this);
+}
+
+Renderer::~Renderer() {
+  flush();
+  {
+    lock_guard<mutex> lock(wakeMutex);
+    running = false;
+    wake.notify_one();
+  }
+  renderThread.join();
+}
+
+// get queue slot for the next scanline, waits
+// for the render thread to drain the queue
+// if it is full
+queued_line_t *Renderer::nextLine() {
+  queued_line_t *entry = queue.back();
+  if (entry == nullptr) {
+    waitDrained();
+    entry = queue.back();
+  }
+  entry->frameEnd = false;
+  return entry;
+}
+
+// send scanline written into the slot
+// returned by nextLine to the render thread
+void Renderer::queueLine() { queue.push(); }
+
+// mark the end of a frame, the render thread
+// presents the frame once it reaches this entry
+void Renderer::queueFrameEnd() {
+  nextLine()->frameEnd = true;
+  queue.push();
+  wakeRenderer();
+}
+
+// wait until every queued scanline has been
+// drawn, after which the emulation thread may
+// draw into the frame buffer itself
+void Renderer::flush() {
+  if (!queue.empty()) waitDrained();
+}
+
+void Renderer::wakeRenderer() {
+  lock_guard<mutex> lock(wakeMutex);
+  wake.notify_one();
+}
+
+// wake the render thread and sleep until
+// it has drawn every queued scanline
+void Renderer::waitDrained() {
+  unique_lock<mutex> lock(wakeMutex);
+  wake.notify_one();
+  drained.wait(lock, [this] { return queue.empty(); });
+}
+
+// render thread loop, sleeps while the queue is
+// empty and is woken at the end of every frame
+// or when the emulation thread waits on it
+void Renderer::render() {
+  while (true) {
+    queued_line_t *entry = queue.front();
+    if (entry == nullptr) {
+      unique_lock<mutex> lock(wakeMutex);
+      drained.notify_one();
+      wake.wait(lock, [this] { return !queue.empty() || !running; });
+      if (!running) return;
+      continue;
+    }
+
+    if (entry->frameEnd) {
+      ppu->frameBuffer->publish();
+      emit ppu->cgb->sendScreen();
+    } else {
+      line_colors_t colors{entry->cramBg, entry->cramObj, entry->dmgColors,
+                           entry->colorTable, entry->dmgMode, entry->cgbMode};
+      ppu->transferScanlineToScreen(entry->scanline, entry->line, colors);
+    }
+    queue.pop();
+  }
+}
@@ -0,0 +1,70 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Renderer (Pipelined Render Thread)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "memory.h"
+#include "ppu.h"
+#include "spscqueue.h"
+#include "types.h"
+
+// enough queued scanlines for almost two frames
+#define RENDER_QUEUE_LINES 256
+
+using namespace std;
+
+// indexed scanline composed by the emulation
+// thread along with the palettes and modes
+// needed to convert it to screen colors
+typedef struct {
+  scanline_t scanline;
+  line_state_t line;
+  uint8 cramBg[PAL_COUNT * PAL_BYTES];
+  uint8 cramObj[PAL_COUNT * PAL_BYTES];
+  uint dmgColors[PALETTE_COLOR_COUNT];
+  const uint *colorTable;
+  bool dmgMode, cgbMode;
+  bool frameEnd;
+} queued_line_t;
+
+// converts queued scanlines to screen colors and
+// presents completed frames on its own thread so
+// the emulation thread only composes pixel indices
+class Renderer {
+ private:
+  PPU *ppu;
+  SpscQueue<queued_line_t, RENDER_QUEUE_LINES> queue;
+  thread renderThread;
+  atomic<bool> running;
+
+  // the render thread sleeps on wake while the
+  // queue is empty and signals drained as it
+  // goes to sleep, both are notified under the
+  // mutex so no wakeup is lost
+  mutex wakeMutex;
+  condition_variable wake, drained;
+
+  void wakeRenderer();
+  void waitDrained();
+  void render();
+
+ public:
+  Renderer(PPU *ppu);
+  ~Renderer();
+
+  // emulation thread functions
+  queued_line_t *nextLine();
+  void queueLine();
+  void queueFrameEnd();
+  void flush();
+};
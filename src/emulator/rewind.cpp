@@ -0,0 +1,224 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Rewind (Delta Compressed Snapshot History)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "rewind.h"
+
+#include <cstring>
+
+#include "cgb.h"
+
+Rewind::Rewind()
+    : current(),
+      next(),
+      delta(),
+      currentFrame(0),
+      lastFrame(0),
+      history(),
+      entries(),
+      firstEntry(0),
+      entryCount(0),
+      writePos(0),
+      cgb(nullptr) {}
+
+// **************************************************
+// **************************************************
+// History Functions
+// **************************************************
+// **************************************************
+
+// called after each emulation step, takes a
+// snapshot when a frame on the interval starts
+void Rewind::update() {
+  if (cgb->frameNumber == lastFrame) return;
+  lastFrame = cgb->frameNumber;
+  if (lastFrame % REWIND_INTERVAL_FRAMES == 0) push();
+}
+
+// snapshot the emulator and store how to get
+// from it back to the previous snapshot
+void Rewind::push() {
+  cgb->snapshot(next);
+  if (next.size() != current.size()) {
+    clear();
+  } else {
+    size_t maxBytes = next.size() + (next.size() / REWIND_MIN_EQUAL_RUN + 1) *
+                                        REWIND_MAX_RUN_HEADER_BYTES;
+    if (delta.size() < maxBytes) delta.resize(maxBytes);
+    store(delta.data(),
+          encode(next.data(), current.data(), next.size(), delta.data()));
+  }
+  current.swap(next);
+  currentFrame = cgb->frameNumber;
+}
+
+// go back to the previous snapshot, the newest
+// snapshot is restored first if the emulator has
+// run past it
+bool Rewind::stepBack() {
+  if (current.empty()) return false;
+  if (cgb->frameNumber <= currentFrame + 1) {
+    if (entryCount == 0) return false;
+    const rewind_entry_t &entry =
+        entries[(firstEntry + entryCount - 1) % REWIND_MAX_ENTRIES];
+    if (!decode(&history[entry.offset], entry.size, current.data(),
+                current.size())) {
+      clear();
+      return false;
+    }
+    writePos = entry.offset;
+    --entryCount;
+  }
+  if (!cgb->restore(current)) return false;
+  currentFrame = cgb->frameNumber;
+  return true;
+}
+
+// forget all snapshots, the history buffer
+// is kept allocated
+void Rewind::clear() {
+  current.clear();
+  firstEntry = entryCount = writePos = 0;
+}
+
+// bytes of history in use
+size_t Rewind::historyBytes() const {
+  size_t bytes = 0;
+  for (size_t idx = 0; idx < entryCount; ++idx) {
+    bytes += entries[(firstEntry + idx) % REWIND_MAX_ENTRIES].size;
+  }
+  return bytes;
+}
+
+// append entry to the ring, going forward from
+// writePos entries are always met oldest first,
+// so dropping the oldest entries frees the space
+// the new entry needs
+void Rewind::store(const uint8 *data, size_t size) {
+  if (history.empty()) {
+    history.resize(REWIND_HISTORY_BYTES);
+    entries.resize(REWIND_MAX_ENTRIES);
+  }
+  if (size > history.size()) {
+    clear();
+    return;
+  }
+
+  // entries past the wrap point are the oldest
+  if (writePos + size > history.size()) {
+    while (entryCount > 0 && entries[firstEntry].offset >= writePos) {
+      dropOldest();
+    }
+    writePos = 0;
+  }
+  while (entryCount > 0) {
+    const rewind_entry_t &oldest = entries[firstEntry];
+    bool overlaps = oldest.offset < writePos + size &&
+                    writePos < oldest.offset + oldest.size;
+    if (!overlaps && entryCount < REWIND_MAX_ENTRIES) break;
+    dropOldest();
+  }
+
+  memcpy(&history[writePos], data, size);
+  entries[(firstEntry + entryCount) % REWIND_MAX_ENTRIES] = {writePos, size};
+  ++entryCount;
+  writePos += size;
+}
+
+void Rewind::dropOldest() {
+  firstEntry = (firstEntry + 1) % REWIND_MAX_ENTRIES;
+  --entryCount;
+}
+
+// **************************************************
+// **************************************************
+// Delta Encoding Functions
+// **************************************************
+// **************************************************
+
+static uint8 *putVarint(uint8 *out, size_t val) {
+  while (val >= 0x80) {
+    *out++ = val | 0x80;
+    val >>= 7;
+  }
+  *out++ = val;
+  return out;
+}
+
+static bool getVarint(const uint8 *&in, const uint8 *end, size_t &val) {
+  val = 0;
+  for (int shift = 0; in < end && shift < 64; shift += 7) {
+    uint8 byte = *in++;
+    val |= (size_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// encode a ^ b as runs of a varint count of equal
+// bytes, a varint count of changed bytes and the
+// xor of the changed bytes, equal bytes are
+// skipped a word at a time since most of the
+// state does not change between snapshots
+size_t Rewind::encode(const uint8 *a, const uint8 *b, size_t size,
+                      uint8 *out) {
+  uint8 *start = out;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t changed = pos;
+    while (changed + sizeof(uint64) <= size &&
+           memcmp(a + changed, b + changed, sizeof(uint64)) == 0) {
+      changed += sizeof(uint64);
+    }
+    while (changed < size && a[changed] == b[changed]) ++changed;
+
+    // changed run ends at the first long equal run
+    size_t end = changed;
+    while (end < size) {
+      if (a[end] != b[end]) {
+        ++end;
+        continue;
+      }
+      size_t equal = end;
+      while (equal < size && equal - end < REWIND_MIN_EQUAL_RUN &&
+             a[equal] == b[equal]) {
+        ++equal;
+      }
+      if (equal == size || equal - end >= REWIND_MIN_EQUAL_RUN) break;
+      end = equal;
+    }
+
+    out = putVarint(out, changed - pos);
+    out = putVarint(out, end - changed);
+    for (size_t idx = changed; idx < end; ++idx) *out++ = a[idx] ^ b[idx];
+    pos = end;
+  }
+  return out - start;
+}
+
+// apply encoded xor to state in place, fails on
+// runs that do not fit the state
+bool Rewind::decode(const uint8 *in, size_t inSize, uint8 *state,
+                    size_t size) {
+  const uint8 *end = in + inSize;
+  size_t pos = 0;
+  while (in < end) {
+    size_t equal, changed;
+    if (!getVarint(in, end, equal) || !getVarint(in, end, changed)) {
+      return false;
+    }
+    if (equal > size - pos || changed > size - pos - equal ||
+        changed > (size_t)(end - in)) {
+      return false;
+    }
+    pos += equal;
+    for (size_t idx = 0; idx < changed; ++idx) state[pos + idx] ^= in[idx];
+    pos += changed;
+    in += changed;
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Rewind (Delta Compressed Snapshot History)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+// a snapshot is taken every REWIND_INTERVAL_FRAMES
+// frames, deltas are dropped oldest first once the
+// history or the entry table is full
+#define REWIND_INTERVAL_FRAMES 4
+#define REWIND_HISTORY_BYTES 0x3000000
+#define REWIND_MAX_ENTRIES 0x8000
+
+// equal bytes needed to end a run of changed bytes,
+// shorter equal runs are cheaper to keep in the run
+#define REWIND_MIN_EQUAL_RUN 8
+#define REWIND_MAX_RUN_HEADER_BYTES 20
+
+using namespace std;
+
+class CGB;
+
+typedef struct {
+  size_t offset;
+  size_t size;
+} rewind_entry_t;
+
+// only the newest snapshot is kept whole, each
+// history entry is the xor of a snapshot with the
+// one before it, run length encoded, so walking
+// the history backwards rebuilds older snapshots
+class Rewind {
+ private:
+  vector<uint8> current, next, delta;
+  uint64 currentFrame, lastFrame;
+
+  // history is a byte ring, entries are stored
+  // oldest to newest from firstEntry
+  vector<uint8> history;
+  vector<rewind_entry_t> entries;
+  size_t firstEntry, entryCount, writePos;
+
+  void push();
+  void store(const uint8 *data, size_t size);
+  void dropOldest();
+  static size_t encode(const uint8 *a, const uint8 *b, size_t size,
+                       uint8 *out);
+  static bool decode(const uint8 *in, size_t inSize, uint8 *state,
+                     size_t size);
+
+ public:
+  CGB *cgb;
+
+  Rewind();
+
+  void update();
+  bool stepBack();
+  void clear();
+  size_t historyBytes() const;
+};
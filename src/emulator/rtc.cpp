@@ -9,102 +9,242 @@
 #include "rtc.h"
 
 #include <QFile>
-#include <chrono>
-#include <fstream>
-#include <thread>
+#include <QFileInfo>
+#include <algorithm>
+#include <sstream>
 
 #include "cgb.h"
 
+// bits of each register that exist in hardware
+const uint8 RTC::regMasks[RTC_REG_COUNT]{0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+
 RTC::RTC()
-    : cgb(nullptr),
-      seconds(0),
-      minutes(0),
-      hours(0),
-      daysLo(0),
-      daysHi(0),
-      clock(system_clock::now().time_since_epoch().count()),
-      latchVal(),
-      rtcRegs(),
-      rtcReg(rtcRegs[0]) {}
-
-// update rtc registers to reflect
-// the current time
-void RTC::latch() {
-  // get time difference between
-  // clock and current timestamp and
-  // update clock to equal timestamp
-  long long now = system_clock::now().time_since_epoch().count();
-  auto timeDiff = now - clock;
-  clock = now;
-
-  // get time elapsed since rtc was last saved
-  auto daysElapsed = timeDiff / US_PER_DAY;
-  timeDiff %= US_PER_DAY;
-  auto hoursElapsed = timeDiff / US_PER_HOUR;
-  timeDiff %= US_PER_HOUR;
-  auto minutesElapsed = timeDiff / US_PER_MINUTE;
-  timeDiff %= US_PER_MINUTE;
-  auto secondsElapsed = timeDiff / US_PER_SECOND_INT;
-
-  // update seconds rtc register
-  uint8 secondsResult = seconds + secondsElapsed;
-  seconds = secondsResult % SECONDS_PER_MINUTE;
-
-  // update minutes rtc register
-  uint8 minutesResult = minutes + minutesElapsed;
-  if (secondsResult >= SECONDS_PER_MINUTE) minutesResult += 1;
-  minutes = minutesResult % MINUTES_PER_HOUR;
-
-  // update hours rtc register
-  uint8 hoursResult = hours + hoursElapsed;
-  if (minutesElapsed >= MINUTES_PER_HOUR) hoursResult += 1;
-  hours = hoursResult % HOURS_PER_DAY;
-
-  // update days rtc register
-  uint16 daysResult = ((daysHi & BIT0_MASK) << 8 | daysLo) + daysElapsed;
-  if (hoursElapsed >= HOURS_PER_DAY) daysResult += 1;
-  daysLo = daysResult;
-  daysHi &= BIT0_MASK;
-  daysHi |= (daysResult >> 8) & BIT0_MASK;
-  if (daysElapsed >= MAX_DAYS) daysHi |= BIT7_MASK;
+    : regs(),
+      latched(),
+      regIdx(0),
+      latchVal(0),
+      clock(0),
+      cgb(nullptr),
+      emulatedTime(false) {}
+
+// current time in microseconds from the master
+// clock or the host clock
+uint64 RTC::now() const {
+  if (emulatedTime) {
+    uint64 cycles = cgb->masterClock;
+    return cycles / T_CYCLES_PER_SEC * US_PER_SECOND_INT +
+           cycles % T_CYCLES_PER_SEC * US_PER_SECOND_INT / T_CYCLES_PER_SEC;
+  }
+  return duration_cast<microseconds>(system_clock::now().time_since_epoch())
+      .count();
+}
+
+// time elapsed that the live registers have
+// not counted yet
+uint64 RTC::pending() const {
+  uint64 current = now();
+  return current > clock ? current - clock : 0;
+}
+
+// count the whole seconds elapsed since the live
+// registers were last counted, the part of a
+// second left over is counted by a later call
+void RTC::advance() {
+  uint64 current = now();
+  if (halted() || current < clock) {
+    clock = current;
+    return;
+  }
+  uint64 elapsed = (current - clock) / US_PER_SECOND_INT;
+  if (elapsed == 0) return;
+  clock += elapsed * US_PER_SECOND_INT;
+
+  // day counter overflow sets the carry flag,
+  // which stays set until the game clears it
+  uint64 total = time() + elapsed;
+  uint64 days = total / SECONDS_PER_DAY;
+  uint8 flags = regs[RTC_DH] & (BIT6_MASK | BIT7_MASK);
+  if (days >= MAX_DAYS) flags |= BIT7_MASK;
+  days %= MAX_DAYS;
+  regs[RTC_S] = total % SECONDS_PER_MINUTE;
+  regs[RTC_M] = total / SECONDS_PER_MINUTE % MINUTES_PER_HOUR;
+  regs[RTC_H] = total / (SECONDS_PER_MINUTE * MINUTES_PER_HOUR) % HOURS_PER_DAY;
+  regs[RTC_DL] = days;
+  regs[RTC_DH] = flags | ((days >> 8) & BIT0_MASK);
+}
+
+// select register mapped to external ram
+void RTC::select(uint8 reg) { regIdx = (reg - RTC_REG_START_IDX) % RTC_REG_COUNT; }
+
+uint8 RTC::read() const { return latched[regIdx]; }
+
+// writes set the live register and show in the
+// latched copy, writing seconds also restarts
+// the current second
+void RTC::write(uint8 val) {
+  advance();
+  regs[regIdx] = latched[regIdx] = val & regMasks[regIdx];
+  if (regIdx == RTC_S) clock = now();
+}
+
+// writing 0 then 1 copies the live registers
+// to the registers read by the game
+void RTC::latch(uint8 val) {
+  if (latchVal == 0 && val == 1) {
+    advance();
+    copy(regs, regs + RTC_REG_COUNT, latched);
+  }
+  latchVal = val;
 }
 
-void RTC::resetClock() {
-  clock = system_clock::now().time_since_epoch().count();
+// switch time source, time not yet counted
+// carries over to the new source
+void RTC::setEmulatedTime(bool enabled) {
+  if (enabled == emulatedTime) return;
+  advance();
+  uint64 carry = pending();
+  emulatedTime = enabled;
+  uint64 current = now();
+  clock = current - min(carry, current);
 }
 
-bool RTC::halted() { return daysHi & BIT6_MASK; }
+bool RTC::halted() const { return regs[RTC_DH] & BIT6_MASK; }
+
+// live registers as seconds counted by the
+// clock, ignoring the halt and carry flags
+uint64 RTC::time() const {
+  uint64 days = (regs[RTC_DH] & BIT0_MASK) << 8 | regs[RTC_DL];
+  return ((days * HOURS_PER_DAY + regs[RTC_H]) * MINUTES_PER_HOUR +
+          regs[RTC_M]) *
+             SECONDS_PER_MINUTE +
+         regs[RTC_S];
+}
+
+// set live and latched registers to the given
+// seconds with no flags set and restart the clock
+void RTC::setTime(uint64 time) {
+  uint64 days = time / SECONDS_PER_DAY % MAX_DAYS;
+  regs[RTC_S] = time % SECONDS_PER_MINUTE;
+  regs[RTC_M] = time / SECONDS_PER_MINUTE % MINUTES_PER_HOUR;
+  regs[RTC_H] = time / (SECONDS_PER_MINUTE * MINUTES_PER_HOUR) % HOURS_PER_DAY;
+  regs[RTC_DL] = days;
+  regs[RTC_DH] = days >> 8;
+  copy(regs, regs + RTC_REG_COUNT, latched);
+  clock = now();
+}
+
+// save registers and the time not yet counted,
+// the clock is placed relative to the master clock
+// on load, which the cgb section restores first
+void RTC::saveState(StateWriter &state) const {
+  state.beginSection(RTC_SECTION);
+  state.write(regs);
+  state.write(latched);
+  state.write(regIdx);
+  state.write(latchVal);
+  state.write(pending());
+  state.endSection();
+}
+
+// version 1 states hold only the registers and
+// the selected register, their time starts now
+void RTC::loadState(StateReader &state) {
+  uint64 carry = 0;
+  if (state.version < 2) {
+    state.readBytes(regs, RTC_REG_COUNT);
+    state.read(latchVal);
+    state.read(regIdx);
+    copy(regs, regs + RTC_REG_COUNT, latched);
+  } else {
+    state.read(regs);
+    state.read(latched);
+    state.read(regIdx);
+    state.read(latchVal);
+    state.read(carry);
+  }
+  regIdx %= RTC_REG_COUNT;
+  uint64 current = now();
+  clock = current - min(carry, current);
+}
+
+// parse the text rtc file written by older
+// versions, five register lines followed by
+// the host clock count it was saved at
+bool RTC::loadLegacy(const QByteArray &data, uint64 &savedAt) {
+  istringstream lines(data.toStdString());
+  long long values[RTC_REG_COUNT + 1] = {};
+  for (int idx = 0; idx < RTC_REG_COUNT; ++idx) {
+    if (!(lines >> values[idx])) return false;
+  }
+  lines >> values[RTC_REG_COUNT];
+
+  for (int idx = 0; idx < RTC_REG_COUNT; ++idx) {
+    regs[idx] = values[idx] & regMasks[idx];
+  }
+  copy(regs, regs + RTC_REG_COUNT, latched);
+
+  // the clock count is saved as 0 if the
+  // rtc was halted, so no time has passed
+  system_clock::duration saved(values[RTC_REG_COUNT]);
+  savedAt = values[RTC_REG_COUNT] > 0
+                ? duration_cast<microseconds>(saved).count()
+                : duration_cast<microseconds>(
+                      system_clock::now().time_since_epoch())
+                      .count();
+  return true;
+}
 
+// load rtc saved next to the rom, when following
+// the host clock the time since it was saved is
+// counted as if the cartridge battery kept it running
 void RTC::load() {
-  auto path = cgb->romPath.replace(".gbc", ".rtc");
-  path = path.replace(".gb", ".rtc");
-  QFile rtcFile(path);
-
-  // set rtc registers and clock
-  seconds = stoi(rtcFile.readLine().toStdString());
-  minutes = stoi(rtcFile.readLine().toStdString());
-  hours = stoi(rtcFile.readLine().toStdString());
-  daysLo = stoi(rtcFile.readLine().toStdString());
-  daysHi = stoi(rtcFile.readLine().toStdString());
-  clock = stoll(rtcFile.readLine().toStdString());
-
-  // clock is saved as 0 if rtc was halted
-  if (clock == 0) resetClock();
+  clock = now();
+  QFileInfo romInfo(cgb->romPath);
+  QFile rtcFile(romInfo.path() + "/" + romInfo.completeBaseName() +
+                RTC_EXTENSION);
+  if (!rtcFile.open(QIODevice::ReadOnly)) return;
+  QByteArray data = rtcFile.readAll();
+  rtcFile.close();
+  StateReader state((const uint8 *)data.constData(), data.size(),
+                    RTC_FILE_MAGIC, RTC_FILE_VERSION);
+
+  // legacy text files are converted to
+  // the binary format once loaded
+  uint64 savedAt = 0;
+  bool legacy = false;
+  if (state.validate({RTC_SECTION, RTC_HOST_TIME_SECTION})) {
+    uint32 tag = 0;
+    while (state.nextSection(tag)) {
+      if (tag == RTC_SECTION) loadState(state);
+      if (tag == RTC_HOST_TIME_SECTION) state.read(savedAt);
+    }
+  } else if (loadLegacy(data, savedAt)) {
+    legacy = true;
+  } else {
+    return;
+  }
+
+  uint64 current = now();
+  if (!emulatedTime && current > savedAt) {
+    clock -= min(current - savedAt, clock);
+  }
+  if (legacy) save();
 }
 
 void RTC::save() {
-  auto path = cgb->romPath.replace(".gbc", ".rtc");
-  path = path.replace(".gb", ".rtc");
-  QFile rtcFile(path);
-
-  // save rtc registers and current
-  // system timestamp
-  rtcFile.write((to_string(seconds) + "\n").c_str());
-  rtcFile.write((to_string(minutes) + "\n").c_str());
-  rtcFile.write((to_string(hours) + "\n").c_str());
-  rtcFile.write((to_string(daysLo) + "\n").c_str());
-  rtcFile.write((to_string(daysHi) + "\n").c_str());
-  rtcFile.write(
-      to_string(halted() ? 0 : system_clock::now().time_since_epoch().count())
-          .c_str());
+  vector<uint8> buffer;
+  StateWriter state(buffer, RTC_FILE_MAGIC, RTC_FILE_VERSION);
+  saveState(state);
+  state.beginSection(RTC_HOST_TIME_SECTION);
+  state.write((uint64)duration_cast<microseconds>(
+                  system_clock::now().time_since_epoch())
+                  .count());
+  state.endSection();
+
+  QFileInfo romInfo(cgb->romPath);
+  QFile rtcFile(romInfo.path() + "/" + romInfo.completeBaseName() +
+                RTC_EXTENSION);
+  if (rtcFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    rtcFile.write((const char *)buffer.data(), buffer.size());
+  }
 }
@@ -8,9 +8,10 @@
 
 #pragma once
 
-#include <array>
+#include <QByteArray>
 #include <chrono>
 
+#include "savestate.h"
 #include "types.h"
 
 #define RTC_REG_COUNT 5
@@ -19,39 +20,68 @@
 #define SECONDS_PER_MINUTE 60ll
 #define MINUTES_PER_HOUR 60ll
 #define HOURS_PER_DAY 24ll
-
+#define SECONDS_PER_DAY (HOURS_PER_DAY * MINUTES_PER_HOUR * SECONDS_PER_MINUTE)
 #define US_PER_SECOND_INT 1000000ll
-#define US_PER_MINUTE (SECONDS_PER_MINUTE * US_PER_SECOND_INT)
-#define US_PER_HOUR (MINUTES_PER_HOUR * US_PER_MINUTE)
-#define US_PER_DAY (HOURS_PER_DAY * US_PER_HOUR)
 
 #define MAX_DAYS 512
 
+// rtc file holds the rtc section of a save state
+// and the host time it was saved at, its version
+// selects the layout of the rtc section
+#define RTC_EXTENSION ".rtc"
+#define RTC_FILE_MAGIC STATE_TAG('D', 'M', 'R', 'T')
+#define RTC_FILE_VERSION 2
+#define RTC_HOST_TIME_SECTION STATE_TAG('H', 'O', 'S', 'T')
+
 using namespace std;
 using namespace chrono;
 
 class CGB;
 
+// rtc registers
+enum RtcReg { RTC_S, RTC_M, RTC_H, RTC_DL, RTC_DH };
+
 class RTC {
  private:
-  uint8 seconds;
-  uint8 minutes;
-  uint8 hours;
-  uint8 daysLo;
-  uint8 daysHi;
+  static const uint8 regMasks[RTC_REG_COUNT];
+
+  // the game reads the registers copied by
+  // the last latch while the live registers
+  // keep counting
+  uint8 regs[RTC_REG_COUNT];
+  uint8 latched[RTC_REG_COUNT];
+  uint8 regIdx;
   uint8 latchVal;
-  long long clock;
+
+  // time in microseconds up to which the live
+  // registers have been counted
+  uint64 clock;
+
+  uint64 now() const;
+  uint64 pending() const;
+  void advance();
+  bool loadLegacy(const QByteArray &data, uint64 &savedAt);
 
  public:
   CGB *cgb;
-  uint8 *rtcRegs[RTC_REG_COUNT];
-  uint8 *rtcReg;
+
+  // count emulated time from the master clock
+  // instead of host time, so runs are reproducible
+  // and fast forwarding moves the clock as fast
+  bool emulatedTime;
 
   RTC();
 
-  void latch();
-  void resetClock();
-  bool halted();
+  void select(uint8 reg);
+  uint8 read() const;
+  void write(uint8 val);
+  void latch(uint8 val);
+  void setEmulatedTime(bool enabled);
+  bool halted() const;
+  uint64 time() const;
+  void setTime(uint64 time);
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
   void load();
   void save();
 };
@@ -0,0 +1,131 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Save State (Versioned Sectioned Binary Format)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "savestate.h"
+
+#include <algorithm>
+
+// **************************************************
+// **************************************************
+// State Writer Functions
+// **************************************************
+// **************************************************
+
+StateWriter::StateWriter(vector<uint8> &buffer, uint32 magic, uint32 version)
+    : buffer(buffer), sectionStart(0) {
+  buffer.clear();
+  buffer.resize(STATE_HEADER_BYTES);
+  put32(0, magic);
+  put32(4, version);
+}
+
+// values are stored little endian
+void StateWriter::put32(size_t offset, uint32 val) {
+  for (int i = 0; i < 4; ++i) buffer[offset + i] = val >> (i * 8);
+}
+
+// start section, its size is filled in by endSection
+void StateWriter::beginSection(uint32 tag) {
+  sectionStart = buffer.size();
+  buffer.resize(sectionStart + SECTION_HEADER_BYTES);
+  put32(sectionStart, tag);
+}
+
+void StateWriter::endSection() {
+  size_t payload = buffer.size() - sectionStart - SECTION_HEADER_BYTES;
+  put32(sectionStart + 4, payload);
+}
+
+void StateWriter::writeBytes(const void *data, size_t size) {
+  size_t offset = buffer.size();
+  buffer.resize(offset + size);
+  memcpy(&buffer[offset], data, size);
+}
+
+// **************************************************
+// **************************************************
+// State Reader Functions
+// **************************************************
+// **************************************************
+
+StateReader::StateReader(const uint8 *data, size_t size, uint32 magic,
+                         uint32 maxVersion)
+    : data(data),
+      size(size),
+      pos(STATE_HEADER_BYTES),
+      sectionEnd(STATE_HEADER_BYTES),
+      magic(magic),
+      maxVersion(maxVersion),
+      valid(false),
+      version(0) {}
+
+uint32 StateReader::get32(size_t offset) const {
+  uint32 val = 0;
+  for (int i = 0; i < 4; ++i) val |= (uint32)data[offset + i] << (i * 8);
+  return val;
+}
+
+// check header and section framing and that every
+// required section is present, done before any
+// component is touched so a bad state changes nothing
+bool StateReader::validate(initializer_list<uint32> requiredTags) {
+  valid = false;
+  if (size < STATE_HEADER_BYTES || get32(0) != magic) return false;
+  version = get32(4);
+  if (version == 0 || version > maxVersion) return false;
+
+  // bit n of found is set once the nth required
+  // tag is seen, no allocation so restoring a
+  // snapshot stays cheap
+  uint64 found = 0;
+  uint64 required = (1ull << requiredTags.size()) - 1;
+  size_t offset = STATE_HEADER_BYTES;
+  while (offset < size) {
+    if (size - offset < SECTION_HEADER_BYTES) return false;
+    uint32 payload = get32(offset + 4);
+    if (payload > size - offset - SECTION_HEADER_BYTES) return false;
+    auto tag = find(requiredTags.begin(), requiredTags.end(), get32(offset));
+    if (tag != requiredTags.end()) found |= 1ull << (tag - requiredTags.begin());
+    offset += SECTION_HEADER_BYTES + payload;
+  }
+  if (found != required) return false;
+
+  pos = sectionEnd = STATE_HEADER_BYTES;
+  valid = true;
+  return true;
+}
+
+// move to the next section, skipping whatever
+// was left unread in the current one
+bool StateReader::nextSection(uint32 &tag) {
+  pos = sectionEnd;
+  if (!valid || pos >= size) return false;
+  tag = get32(pos);
+  sectionEnd = pos + SECTION_HEADER_BYTES + get32(pos + 4);
+  pos += SECTION_HEADER_BYTES;
+  return true;
+}
+
+void StateReader::readBytes(void *dst, size_t count) {
+  if (!valid || count > sectionEnd - pos) {
+    valid = false;
+    memset(dst, 0, count);
+    return;
+  }
+  memcpy(dst, data + pos, count);
+  pos += count;
+}
+
+// mark the state as unusable, used by components
+// that find a payload which does not fit this cartridge
+void StateReader::fail() { valid = false; }
+
+bool StateReader::ok() const { return valid; }
+
+// bytes left unread in the current section
+size_t StateReader::remaining() const { return valid ? sectionEnd - pos : 0; }
@@ -0,0 +1,97 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Save State (Versioned Sectioned Binary Format)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+
+#include "types.h"
+
+// a state is a header followed by sections, each
+// section is a tag, a payload size and the payload,
+// readers skip sections they do not recognize, other
+// files such as movies use the same layout with
+// their own magic
+#define STATE_TAG(a, b, c, d) \
+  ((uint32)(a) | (uint32)(b) << 8 | (uint32)(c) << 16 | (uint32)(d) << 24)
+#define STATE_MAGIC STATE_TAG('D', 'M', 'S', 'T')
+#define STATE_VERSION 2
+#define STATE_HEADER_BYTES 8
+#define SECTION_HEADER_BYTES 8
+
+#define CGB_SECTION STATE_TAG('C', 'G', 'B', ' ')
+#define CPU_SECTION STATE_TAG('C', 'P', 'U', ' ')
+#define MEMORY_SECTION STATE_TAG('M', 'E', 'M', ' ')
+#define MBC_SECTION STATE_TAG('M', 'B', 'C', ' ')
+#define RTC_SECTION STATE_TAG('R', 'T', 'C', ' ')
+#define TIMERS_SECTION STATE_TAG('T', 'I', 'M', 'R')
+#define PPU_SECTION STATE_TAG('P', 'P', 'U', ' ')
+#define APU_SECTION STATE_TAG('A', 'P', 'U', ' ')
+#define BOOTSTRAP_SECTION STATE_TAG('B', 'O', 'O', 'T')
+
+using namespace std;
+
+// appends a state to a caller owned buffer, the
+// buffer keeps its capacity so repeated saves into
+// the same buffer do not allocate
+class StateWriter {
+ private:
+  vector<uint8> &buffer;
+  size_t sectionStart;
+
+  void put32(size_t offset, uint32 val);
+
+ public:
+  StateWriter(vector<uint8> &buffer, uint32 magic = STATE_MAGIC,
+              uint32 version = STATE_VERSION);
+
+  void beginSection(uint32 tag);
+  void endSection();
+  void writeBytes(const void *data, size_t size);
+
+  template <typename T>
+  void write(const T &val) {
+    static_assert(is_trivially_copyable<T>::value, "state must be plain data");
+    writeBytes(&val, sizeof(T));
+  }
+};
+
+// reads a state from memory, every read is bounds
+// checked against the current section and a failed
+// read clears ok instead of reading past the end
+class StateReader {
+ private:
+  const uint8 *data;
+  size_t size, pos, sectionEnd;
+  uint32 magic, maxVersion;
+  bool valid;
+
+  uint32 get32(size_t offset) const;
+
+ public:
+  uint32 version;
+
+  StateReader(const uint8 *data, size_t size, uint32 magic = STATE_MAGIC,
+              uint32 maxVersion = STATE_VERSION);
+
+  bool validate(initializer_list<uint32> requiredTags);
+  bool nextSection(uint32 &tag);
+  void readBytes(void *dst, size_t count);
+  void fail();
+  bool ok() const;
+  size_t remaining() const;
+
+  template <typename T>
+  void read(T &val) {
+    static_assert(is_trivially_copyable<T>::value, "state must be plain data");
+    readBytes(&val, sizeof(T));
+  }
+};
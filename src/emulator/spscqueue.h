@@ -0,0 +1,86 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Single Producer Single Consumer Queue
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+// lock-free ring buffer with one producer thread and
+// one consumer thread, slots are written and read in
+// place or copied in bulk for small entries
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "queue size must be a power of two");
+
+ private:
+  T entries[N];
+  alignas(64) atomic<size_t> head;
+  alignas(64) atomic<size_t> tail;
+
+ public:
+  SpscQueue() : entries(), head(0), tail(0) {}
+
+  // get slot to write the next entry into,
+  // returns null if the queue is full
+  T *back() {
+    size_t h = head.load(memory_order_relaxed);
+    if (h - tail.load(memory_order_acquire) == N) return nullptr;
+    return &entries[h & (N - 1)];
+  }
+
+  // make entry written into back slot
+  // visible to the consumer
+  void push() {
+    head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+  }
+
+  // get oldest entry in the queue,
+  // returns null if the queue is empty
+  T *front() {
+    size_t t = tail.load(memory_order_relaxed);
+    if (t == head.load(memory_order_acquire)) return nullptr;
+    return &entries[t & (N - 1)];
+  }
+
+  // release front slot back to the producer
+  void pop() {
+    tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+  }
+
+  // copy up to count entries into the queue,
+  // returns number of entries written
+  size_t write(const T *src, size_t count) {
+    size_t h = head.load(memory_order_relaxed);
+    count = min(count, N - (h - tail.load(memory_order_acquire)));
+    for (size_t i = 0; i < count; ++i) entries[(h + i) & (N - 1)] = src[i];
+    head.store(h + count, memory_order_release);
+    return count;
+  }
+
+  // copy up to count entries out of the queue,
+  // returns number of entries read
+  size_t read(T *dst, size_t count) {
+    size_t t = tail.load(memory_order_relaxed);
+    count = min(count, head.load(memory_order_acquire) - t);
+    for (size_t i = 0; i < count; ++i) dst[i] = entries[(t + i) & (N - 1)];
+    tail.store(t + count, memory_order_release);
+    return count;
+  }
+
+  size_t size() const {
+    return head.load(memory_order_acquire) - tail.load(memory_order_acquire);
+  }
+
+  bool empty() const {
+    return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+  }
+};
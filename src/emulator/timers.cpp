@@ -9,6 +9,7 @@
 #include "timers.h"
 
 #include "cgb.h"
+#include "savestate.h"
 
 const uint16 Timers::internalCounterMasks[4]{TAC_00, TAC_01, TAC_10, TAC_11};
 
@@ -59,5 +60,20 @@ uint8 Timers::timerFreq() const {
 // div, and tima to 0
 void Timers::reset() {
   internalCounter = 4;
+  timaOverflow = false;
   cgb->mem.getByte(DIV) = 0;
 }
+
+// div, tima, tma and tac live in memory, only
+// the internal counter needs saving here
+void Timers::saveState(StateWriter &state) const {
+  state.beginSection(TIMERS_SECTION);
+  state.write(internalCounter);
+  state.write(timaOverflow);
+  state.endSection();
+}
+
+void Timers::loadState(StateReader &state) {
+  state.read(internalCounter);
+  state.read(timaOverflow);
+}
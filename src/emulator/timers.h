@@ -21,6 +21,8 @@
 #define DIV_MASK 0xFF00
 
 class CGB;
+class StateReader;
+class StateWriter;
 
 class Timers {
  private:
@@ -38,4 +40,6 @@ class Timers {
 
   void step();
   void reset();
+  void saveState(StateWriter &state) const;
+  void loadState(StateReader &state);
 };
@@ -24,3 +24,4 @@ typedef unsigned char uint8;
 typedef short int16;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
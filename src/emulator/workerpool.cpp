@@ -0,0 +1,124 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Worker Pool (Parallel Jobs)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#include "workerpool.h"
+
+WorkerPool::WorkerPool(int threadCount)
+    : workers(),
+      job(),
+      nextJob(0),
+      pendingJobs(0),
+      jobCount(0),
+      activeWorkers(0),
+      batchNum(0),
+      stopping(false) {
+  for (int i = 0; i < max(threadCount, 1); ++i) {
+    workers.emplace_back(&WorkerPool::work, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  wait();
+  {
+    lock_guard<mutex> lock(poolMutex);
+    stopping = true;
+  }
+  batchReady.notify_all();
+  for (auto &worker : workers) worker.join();
+}
+
+// start running jobs 0 to count - 1 on
+// the worker threads without waiting
+// for them to complete
+void WorkerPool::dispatch(int count, function<void(int)> batchJob) {
+  wait();
+  {
+    lock_guard<mutex> lock(poolMutex);
+    job = std::move(batchJob);
+    jobCount = count;
+    pendingJobs = count;
+    ++batchNum;
+    nextJob = (uint64)batchNum << 32;
+  }
+  batchReady.notify_all();
+}
+
+// wait for the current batch to complete,
+// the calling thread helps run any jobs
+// that have not been started yet
+void WorkerPool::wait() {
+  uint32 batch;
+  int count;
+  {
+    lock_guard<mutex> lock(poolMutex);
+    batch = batchNum;
+    count = jobCount;
+  }
+  runJobs(batch, count);
+  unique_lock<mutex> lock(poolMutex);
+  batchDone.wait(lock,
+                 [this] { return pendingJobs == 0 && activeWorkers == 0; });
+}
+
+// run a batch of jobs and wait for
+// all of them to complete
+void WorkerPool::run(int count, function<void(int)> batchJob) {
+  dispatch(count, std::move(batchJob));
+  wait();
+}
+
+// worker thread loop, the batch is read under
+// the lock so it matches the job count
+void WorkerPool::work() {
+  uint32 lastBatchNum = 0;
+  int count = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(poolMutex);
+      batchReady.wait(lock,
+                      [&] { return stopping || batchNum != lastBatchNum; });
+      if (stopping) return;
+      lastBatchNum = batchNum;
+      count = jobCount;
+      ++activeWorkers;
+    }
+    runJobs(lastBatchNum, count);
+    {
+      lock_guard<mutex> lock(poolMutex);
+      --activeWorkers;
+    }
+    batchDone.notify_all();
+  }
+}
+
+// claim the next job of the given batch, fails
+// once its jobs are all claimed or a newer
+// batch has been dispatched
+bool WorkerPool::claimJob(uint32 batch, int count, int &jobIdx) {
+  uint64 claim = nextJob.load();
+  while ((uint32)(claim >> 32) == batch && (int)(uint32)claim < count) {
+    if (nextJob.compare_exchange_weak(claim, claim + 1)) {
+      jobIdx = (uint32)claim;
+      return true;
+    }
+  }
+  return false;
+}
+
+// claim and run jobs from the given
+// batch until none are left
+void WorkerPool::runJobs(uint32 batch, int count) {
+  int jobIdx;
+  while (claimJob(batch, count, jobIdx)) {
+    job(jobIdx);
+    if (--pendingJobs == 0) {
+      lock_guard<mutex> lock(poolMutex);
+      batchDone.notify_all();
+    }
+  }
+}
@@ -0,0 +1,52 @@
+// **************************************************
+// **************************************************
+// **************************************************
+// Worker Pool (Parallel Jobs)
+// **************************************************
+// **************************************************
+// **************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+using namespace std;
+
+// runs a batch of numbered jobs across a fixed
+// set of threads, a batch can be dispatched and
+// waited on later so the caller keeps running
+class WorkerPool {
+ private:
+  vector<thread> workers;
+  mutex poolMutex;
+  condition_variable batchReady, batchDone;
+  function<void(int)> job;
+
+  // batch number in the upper half and next job
+  // index in the lower half, so a late worker can
+  // never claim a job from a newer batch
+  atomic<uint64> nextJob;
+  atomic<int> pendingJobs;
+  int jobCount, activeWorkers;
+  uint32 batchNum;
+  bool stopping;
+
+  void work();
+  bool claimJob(uint32 batch, int count, int &jobIdx);
+  void runJobs(uint32 batch, int count);
+
+ public:
+  WorkerPool(int threadCount = thread::hardware_concurrency());
+  ~WorkerPool();
+
+  void dispatch(int count, function<void(int)> batchJob);
+  void wait();
+  void run(int count, function<void(int)> batchJob);
+};
@@ -0,0 +1,234 @@
+#include "headless.h"
+
+#include <QCommandLineParser>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using namespace chrono;
+
+// names accepted by --filter, indexed by filter type
+static const char *filterNames[] = {"none", "scale2x", "scale3x", "hq2x",
+                                    "xbr2x"};
+
+Headless::Headless()
+    : cgb(),
+      mixWriter(),
+      stemWriters(),
+      indexFile(),
+      index(),
+      samplePosition(0),
+      filter() {}
+
+Headless::~Headless() { cgb.apu.detachObserver(); }
+
+// check for the headless flag before any qt
+// application object is created
+bool Headless::requested(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], HEADLESS_FLAG) == 0) return true;
+  }
+  return false;
+}
+
+int Headless::run(const QStringList &arguments) {
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Run a Game Boy ROM without a window");
+  parser.addHelpOption();
+  parser.addPositionalArgument("rom", "ROM file to run");
+
+  QCommandLineOption headlessOption("headless", "Run without a window");
+  QCommandLineOption framesOption("frames", "Number of frames to run",
+                                  "count", HEADLESS_DEFAULT_FRAMES);
+  QCommandLineOption dmgOption("dmg", "Run as an original Game Boy");
+  QCommandLineOption fastBootOption(
+      "fast-boot", "Start at the cartridge without running the bootstrap");
+  QCommandLineOption wavOption("wav", "Write mixed audio as WAV", "file");
+  QCommandLineOption rawOption("raw", "Write mixed audio as raw PCM", "file");
+  QCommandLineOption stemsOption(
+      "stems", "Write each channel to <prefix>ch1 to ch4, raw if --raw is set",
+      "prefix");
+  QCommandLineOption indexOption(
+      "frame-index", "Write the first sample and sample count of each frame",
+      "file");
+  QCommandLineOption loadStateOption(
+      "load-state", "Load a save state before running", "file");
+  QCommandLineOption saveStateOption(
+      "save-state", "Write a save state after running", "file");
+  QCommandLineOption movieOption(
+      "movie", "Play a movie, runs for its length unless --frames is set",
+      "file");
+  QCommandLineOption filterOption(
+      "filter", "Upscale each frame with none, scale2x, scale3x, hq2x or xbr2x",
+      "type", filterNames[NO_FILTER]);
+  QCommandLineOption benchOption(
+      "bench", "Report the time spent emulating and filtering each frame");
+  parser.addOptions({headlessOption, framesOption, dmgOption, fastBootOption,
+                     wavOption, rawOption, stemsOption, indexOption,
+                     loadStateOption, saveStateOption, movieOption,
+                     filterOption, benchOption});
+  parser.process(arguments);
+
+  if (parser.positionalArguments().isEmpty()) parser.showHelp(1);
+  QString romPath = parser.positionalArguments().first();
+  if (!QFile::exists(romPath)) {
+    fprintf(stderr, "ROM not found: %s\n", romPath.toStdString().c_str());
+    return 1;
+  }
+  if (!setFilter(parser.value(filterOption))) return 1;
+
+  // a movie picks the device it was recorded on
+  bool playMovie = parser.isSet(movieOption);
+  if (playMovie && !cgb.movie.load(parser.value(movieOption))) {
+    fprintf(stderr, "Could not load movie %s\n",
+            parser.value(movieOption).toStdString().c_str());
+    return 1;
+  }
+
+  // load rom the same way the main window does,
+  // the rtc counts emulated time so runs repeat
+  cgb.rtc.emulatedTime = true;
+  cgb.bootstrap.fastBoot = parser.isSet(fastBootOption);
+  cgb.cgbMode = playMovie ? cgb.movie.cgbMode : !parser.isSet(dmgOption);
+  cgb.romPath = romPath;
+  cgb.reset();
+  if (!cgb.loadRom(romPath)) {
+    fprintf(stderr, "Bank type %s is not supported\n",
+            cgb.mbc.bankTypeStr().c_str());
+    return 1;
+  }
+  if (parser.isSet(loadStateOption) &&
+      !loadState(parser.value(loadStateOption))) {
+    return 1;
+  }
+  if (playMovie && !cgb.movie.play()) {
+    fprintf(stderr, "Movie was recorded with another ROM\n");
+    return 1;
+  }
+
+  // open outputs, stems use the format of the mix
+  AudioFileFormat format = parser.isSet(rawOption) ? RAW_FILE : WAV_FILE;
+  QString extension = format == RAW_FILE ? ".raw" : ".wav";
+  bool opened = true;
+  if (parser.isSet(wavOption)) {
+    opened &= openWriter(mixWriter, parser.value(wavOption), WAV_FILE, 2);
+  } else if (parser.isSet(rawOption)) {
+    opened &= openWriter(mixWriter, parser.value(rawOption), RAW_FILE, 2);
+  }
+  bool stems = parser.isSet(stemsOption);
+  for (int idx = 0; stems && idx < CHANNEL_COUNT; ++idx) {
+    QString path = parser.value(stemsOption) + "ch" +
+                   QString::number(idx + 1) + extension;
+    opened &= openWriter(stemWriters[idx], path, format, 1);
+  }
+  if (parser.isSet(indexOption)) {
+    indexFile.setFileName(parser.value(indexOption));
+    if (indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      index.setDevice(&indexFile);
+      index << "frame,first_sample,sample_count\n";
+    } else {
+      opened = false;
+    }
+  }
+  if (!opened) return 1;
+
+  // samples are captured on this thread as each
+  // frame ends, so frames and samples line up,
+  // movie input changes as each frame starts
+  cgb.apu.attachObserver(this, stems);
+  uint64 frames = parser.value(framesOption).toULongLong();
+  if (playMovie && !parser.isSet(framesOption)) {
+    frames = cgb.movie.frameCount();
+  }
+  nanoseconds emulationTime(0), filterTime(0);
+  for (uint64 frame = 0; frame < frames; ++frame) {
+    auto start = steady_clock::now();
+    cgb.runFrame();
+    auto emulated = steady_clock::now();
+    if (filter.type != NO_FILTER) filter.apply(*cgb.frameBuffer.acquire());
+    emulationTime += emulated - start;
+    filterTime += steady_clock::now() - emulated;
+    cgb.movie.nextFrame();
+  }
+  cgb.apu.detachObserver();
+
+  if (parser.isSet(benchOption) && frames > 0) {
+    printf("%llu frames, emulation %.1f us/frame, %s %.1f us/frame\n",
+           (unsigned long long)frames,
+           duration<double, micro>(emulationTime).count() / frames,
+           filterNames[filter.type],
+           duration<double, micro>(filterTime).count() / frames);
+  }
+
+  if (mixWriter) mixWriter->close();
+  for (auto &writer : stemWriters) {
+    if (writer) writer->close();
+  }
+  if (indexFile.isOpen()) {
+    index.flush();
+    indexFile.close();
+  }
+  if (parser.isSet(saveStateOption) &&
+      !saveState(parser.value(saveStateOption))) {
+    return 1;
+  }
+  return 0;
+}
+
+// select the filter applied to each frame by name
+bool Headless::setFilter(const QString &name) {
+  for (int type = NO_FILTER; type <= XBR2X; ++type) {
+    if (name == filterNames[type]) {
+      filter.type = (FilterType)type;
+      return true;
+    }
+  }
+  fprintf(stderr, "Unknown filter %s\n", name.toStdString().c_str());
+  return false;
+}
+
+bool Headless::loadState(const QString &path) {
+  QFile stateFile(path);
+  if (stateFile.open(QIODevice::ReadOnly)) {
+    QByteArray data = stateFile.readAll();
+    const uint8 *bytes = (const uint8 *)data.constData();
+    if (cgb.loadState(vector<uint8>(bytes, bytes + data.size()))) return true;
+  }
+  fprintf(stderr, "Could not load state %s\n", path.toStdString().c_str());
+  return false;
+}
+
+bool Headless::saveState(const QString &path) {
+  vector<uint8> buffer;
+  cgb.snapshot(buffer);
+  QFile stateFile(path);
+  if (stateFile.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+      stateFile.write((const char *)buffer.data(), buffer.size()) ==
+          (qint64)buffer.size()) {
+    return true;
+  }
+  fprintf(stderr, "Could not write state %s\n", path.toStdString().c_str());
+  return false;
+}
+
+bool Headless::openWriter(unique_ptr<AudioWriter> &writer, const QString &path,
+                          AudioFileFormat format, uint16 channels) {
+  writer = make_unique<AudioWriter>();
+  if (writer->open(path, format, channels, AUDIO_SAMPLE_RATE)) return true;
+  fprintf(stderr, "Could not open %s\n", path.toStdString().c_str());
+  return false;
+}
+
+void Headless::samplesCaptured(const int16 *mix, const int16 *const *stems,
+                               uint32 count) {
+  if (mixWriter) mixWriter->write(mix, count * 2);
+  for (int idx = 0; idx < CHANNEL_COUNT; ++idx) {
+    if (stemWriters[idx] && stems[idx]) {
+      stemWriters[idx]->write(stems[idx], count);
+    }
+  }
+  if (indexFile.isOpen()) {
+    index << cgb.frameNumber << ',' << samplePosition << ',' << count << '\n';
+  }
+  samplePosition += count;
+}
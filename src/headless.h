@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <array>
+#include <memory>
+
+#include "emulator/audiowriter.h"
+#include "emulator/cgb.h"
+#include "ui/filters.h"
+
+#define HEADLESS_FLAG "--headless"
+#define HEADLESS_DEFAULT_FRAMES "600"
+
+using namespace std;
+
+// runs a rom for a fixed number of frames without
+// a window, capturing the mixed audio and optional
+// per-channel stems along with an index of where
+// each frame starts in the sample stream, frames
+// can be upscaled to benchmark the filters
+class Headless : public APUObserver {
+ public:
+  Headless();
+  ~Headless();
+
+  static bool requested(int argc, char *argv[]);
+  int run(const QStringList &arguments);
+
+  void samplesCaptured(const int16 *mix, const int16 *const *stems,
+                       uint32 count) override;
+
+ private:
+  CGB cgb;
+  unique_ptr<AudioWriter> mixWriter;
+  array<unique_ptr<AudioWriter>, CHANNEL_COUNT> stemWriters;
+  QFile indexFile;
+  QTextStream index;
+  uint64 samplePosition;
+  Filter filter;
+
+  bool setFilter(const QString &name);
+  bool loadState(const QString &path);
+  bool saveState(const QString &path);
+  bool openWriter(unique_ptr<AudioWriter> &writer, const QString &path,
+                  AudioFileFormat format, uint16 channels);
+};
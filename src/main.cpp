@@ -1,8 +1,16 @@
 #include <QApplication>
+#include <QCoreApplication>
 
+#include "headless.h"
 #include "ui/mainwindow.h"
 
 int main(int argc, char *argv[]) {
+  if (Headless::requested(argc, argv)) {
+    QCoreApplication a(argc, argv);
+    Headless headless;
+    return headless.run(a.arguments());
+  }
+
   QApplication a(argc, argv);
   MainWindow w;
   w.show();
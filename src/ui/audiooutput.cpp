@@ -0,0 +1,125 @@
+#include "audiooutput.h"
+
+#include <algorithm>
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#include <QMediaDevices>
+#else
+#include <QAudioDeviceInfo>
+#endif
+
+using namespace std;
+
+AudioOutput::AudioOutput(APU *apu, QObject *parent)
+    : QIODevice(parent),
+      apu(apu),
+      sink(nullptr),
+      outputRate(AUDIO_SAMPLE_RATE),
+      resampler(),
+      staging() {}
+
+AudioOutput::~AudioOutput() { stop(); }
+
+// open default output device in pull mode, falling
+// back to the device sample rate if 48 khz is not
+// supported since the resampler covers the difference
+void AudioOutput::start() {
+  QAudioFormat format;
+  format.setSampleRate(AUDIO_SAMPLE_RATE);
+  format.setChannelCount(AUDIO_CHANNELS);
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+  format.setSampleFormat(QAudioFormat::Int16);
+  auto device = QMediaDevices::defaultAudioOutput();
+  if (!device.isFormatSupported(format)) {
+    format.setSampleRate(device.preferredFormat().sampleRate());
+  }
+#else
+  format.setSampleSize(16);
+  format.setCodec("audio/pcm");
+  format.setSampleType(QAudioFormat::SignedInt);
+  format.setByteOrder(QAudioFormat::LittleEndian);
+  auto device = QAudioDeviceInfo::defaultOutputDevice();
+  if (!device.isFormatSupported(format)) {
+    format.setSampleRate(device.nearestFormat(format).sampleRate());
+  }
+#endif
+
+  // staging holds a block of input at the
+  // fastest ratio the ring fill can ask for
+  outputRate = format.sampleRate();
+  double maxRatio =
+      (double)AUDIO_SAMPLE_RATE / outputRate * (1.0 + AUDIO_MAX_RATE_DELTA);
+  resampler.configure(AUDIO_SAMPLE_RATE, outputRate, maxRatio);
+  staging.assign(resampler.capacity() * AUDIO_CHANNELS, 0);
+  sink = new AudioSink(device, format, this);
+  sink->setBufferSize(AUDIO_DEVICE_BUFFER_BYTES);
+  connect(sink, &AudioSink::stateChanged, this, &AudioOutput::stateChanged);
+  open(QIODevice::ReadOnly);
+  sink->start(this);
+}
+
+void AudioOutput::stop() {
+  if (sink != nullptr) {
+    sink->stop();
+    delete sink;
+    sink = nullptr;
+  }
+  apu->audioSync = false;
+  close();
+}
+
+bool AudioOutput::isSequential() const { return true; }
+
+// silence is produced when the ring runs dry,
+// so the device can always read a full buffer
+qint64 AudioOutput::bytesAvailable() const {
+  return AUDIO_DEVICE_BUFFER_BYTES + QIODevice::bytesAvailable();
+}
+
+// input frames consumed per output frame, sped up
+// when the ring is above its target fill and slowed
+// down below it
+double AudioOutput::resampleRatio() const {
+  double fill = apu->ring.size() / AUDIO_CHANNELS;
+  double error = (fill - AUDIO_TARGET_FRAMES) / AUDIO_TARGET_FRAMES;
+  error = clamp(error, -1.0, 1.0);
+  return (double)AUDIO_SAMPLE_RATE / outputRate *
+         (1.0 + AUDIO_MAX_RATE_DELTA * error);
+}
+
+qint64 AudioOutput::readData(char *data, qint64 maxSize) {
+  qint64 frames = maxSize / AUDIO_FRAME_BYTES;
+  int16 *out = reinterpret_cast<int16 *>(data);
+  double ratio = resampleRatio();
+
+  for (qint64 done = 0; done < frames;) {
+    size_t block = min<qint64>(frames - done, RESAMPLER_BLOCK_FRAMES);
+    size_t needed = min(resampler.inputFrames(block, ratio),
+                        staging.size() / AUDIO_CHANNELS);
+
+    // the last frame is held if the ring is
+    // empty to avoid a click on underrun
+    size_t read = apu->ring.read(staging.data(), needed * AUDIO_CHANNELS);
+    resampler.push(staging.data(), read / AUDIO_CHANNELS);
+    resampler.pad(needed - read / AUDIO_CHANNELS);
+
+    resampler.process(out, block, ratio);
+    out += block * AUDIO_CHANNELS;
+    done += block;
+  }
+  return frames * AUDIO_FRAME_BYTES;
+}
+
+qint64 AudioOutput::writeData(const char *data, qint64 maxSize) {
+  Q_UNUSED(data);
+  Q_UNUSED(maxSize);
+  return 0;
+}
+
+// emulation is only paced by audio while
+// the device is pulling samples
+void AudioOutput::stateChanged(QAudio::State state) {
+  apu->audioSync =
+      state == QAudio::ActiveState || state == QAudio::IdleState;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QIODevice>
+#include <QtGlobal>
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#include <QAudioSink>
+typedef QAudioSink AudioSink;
+#else
+#include <QAudioOutput>
+typedef QAudioOutput AudioSink;
+#endif
+
+#include <vector>
+
+#include "../emulator/apu.h"
+#include "../emulator/types.h"
+#include "resampler.h"
+
+#define AUDIO_CHANNELS 2
+#define AUDIO_FRAME_BYTES (AUDIO_CHANNELS * sizeof(int16))
+#define AUDIO_DEVICE_BUFFER_BYTES 4096
+
+// largest fraction the resampling ratio is nudged
+// by when the ring is empty or twice the target
+#define AUDIO_MAX_RATE_DELTA 0.005
+
+// audio device fed from the apu sample ring, the
+// device pulls samples through readData on its own
+// thread and the resampling ratio follows the ring
+// fill level so the emulator neither starves nor
+// floods the device
+class AudioOutput : public QIODevice {
+  Q_OBJECT
+
+ public:
+  explicit AudioOutput(APU *apu, QObject *parent = nullptr);
+  ~AudioOutput();
+
+  void start();
+  void stop();
+
+  bool isSequential() const override;
+  qint64 bytesAvailable() const override;
+
+ protected:
+  qint64 readData(char *data, qint64 maxSize) override;
+  qint64 writeData(const char *data, qint64 maxSize) override;
+
+ private:
+  APU *apu;
+  AudioSink *sink;
+  int outputRate;
+
+  // ring samples are staged in blocks
+  // before being fed to the resampler
+  Resampler resampler;
+  vector<int16> staging;
+
+  double resampleRatio() const;
+
+ private slots:
+  void stateChanged(QAudio::State state);
+};
@@ -0,0 +1,332 @@
+#include "filters.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+Filter::Filter() : output(), workerPool(), type(NO_FILTER) {}
+
+// filter frame, the returned image is the frame
+// itself when no filter is selected
+const QImage &Filter::apply(const QImage &frame) {
+  if (type == NO_FILTER) return frame;
+
+  int factor = scale(type);
+  if (output.width() != frame.width() * factor ||
+      output.height() != frame.height() * factor ||
+      output.format() != frame.format()) {
+    output = QImage(frame.width() * factor, frame.height() * factor,
+                    frame.format());
+  }
+
+  void (*filter)(const QImage &, QImage &, int, int);
+  switch (type) {
+    case SCALE2X:
+      filter = scale2x;
+      break;
+    case SCALE3X:
+      filter = scale3x;
+      break;
+    case HQ2X:
+      filter = hq2x;
+      break;
+    default:
+      filter = xbr2x;
+      break;
+  }
+
+  if (!workerPool) {
+    int threadCount = thread::hardware_concurrency() - 1;
+    workerPool = make_unique<WorkerPool>(max(threadCount, 1));
+  }
+  int height = frame.height();
+  int bandCount = (height + FILTER_BAND_ROWS - 1) / FILTER_BAND_ROWS;
+  workerPool->run(bandCount, [&](int band) {
+    int startY = band * FILTER_BAND_ROWS;
+    filter(frame, output, startY, min(startY + FILTER_BAND_ROWS, height));
+  });
+  return output;
+}
+
+// get how many times larger the
+// filter output is than its input
+int Filter::scale(FilterType type) {
+  switch (type) {
+    case SCALE2X:
+    case HQ2X:
+    case XBR2X:
+      return 2;
+    case SCALE3X:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+// **************************************************
+// **************************************************
+// Pixel Helper Functions
+// **************************************************
+// **************************************************
+
+namespace {
+
+// get source pixel, coordinates outside
+// the image are clamped to the nearest edge
+inline uint pixelAt(const QImage &src, int x, int y) {
+  x = clamp(x, 0, src.width() - 1);
+  y = clamp(y, 0, src.height() - 1);
+  return ((const uint *)src.constScanLine(y))[x];
+}
+
+// get output row as a pixel pointer
+inline uint *rowAt(QImage &dst, int y) {
+  return (uint *)(dst.bits() + y * dst.bytesPerLine());
+}
+
+// weighted average of two colors
+inline uint blend(uint a, uint b, int weightA, int weightB) {
+  int total = weightA + weightB;
+  uint color = 0xFF000000;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint channel =
+        (((a >> shift) & 0xFF) * weightA + ((b >> shift) & 0xFF) * weightB) /
+        total;
+    color |= channel << shift;
+  }
+  return color;
+}
+
+// weighted average of three colors
+inline uint blend(uint a, uint b, uint c, int weightA, int weightB,
+                  int weightC) {
+  int total = weightA + weightB + weightC;
+  uint color = 0xFF000000;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint channel = (((a >> shift) & 0xFF) * weightA +
+                    ((b >> shift) & 0xFF) * weightB +
+                    ((c >> shift) & 0xFF) * weightC) /
+                   total;
+    color |= channel << shift;
+  }
+  return color;
+}
+
+// difference between two colors in yuv space,
+// returned as separate luma and chroma terms
+struct yuv_diff_t {
+  int y, u, v;
+};
+
+inline yuv_diff_t yuvDiff(uint a, uint b) {
+  int r = (int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF);
+  int g = (int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF);
+  int bl = (int)(a & 0xFF) - (int)(b & 0xFF);
+  return {abs(r * 299 + g * 587 + bl * 114) / 1000,
+          abs(-r * 169 - g * 331 + bl * 500) / 1000,
+          abs(r * 500 - g * 419 - bl * 81) / 1000};
+}
+
+// colors are similar if within the hqx thresholds
+inline bool similar(uint a, uint b) {
+  if (a == b) return true;
+  yuv_diff_t diff = yuvDiff(a, b);
+  return diff.y <= 48 && diff.u <= 7 && diff.v <= 6;
+}
+
+// weighted color distance used by xbr
+inline int distance(uint a, uint b) {
+  yuv_diff_t diff = yuvDiff(a, b);
+  return diff.y * 48 + diff.u * 7 + diff.v * 6;
+}
+
+}  // namespace
+
+// **************************************************
+// **************************************************
+// Filter Functions
+// **************************************************
+// **************************************************
+
+// scale2x, pixels are replaced by a neighbor
+// when that neighbor continues an edge
+void Filter::scale2x(const QImage &src, QImage &dst, int startY, int endY) {
+  int width = src.width();
+  for (int y = startY; y < endY; ++y) {
+    auto row = (const uint *)src.constScanLine(y);
+    auto above = (const uint *)src.constScanLine(max(y - 1, 0));
+    auto below = (const uint *)src.constScanLine(min(y + 1, src.height() - 1));
+    uint *out0 = rowAt(dst, y * 2);
+    uint *out1 = rowAt(dst, y * 2 + 1);
+
+    auto scalePixel = [&](int x) {
+      uint b = above[x], h = below[x], e = row[x];
+      uint d = row[max(x - 1, 0)], f = row[min(x + 1, width - 1)];
+      out0[x * 2] = (d == b && b != f && d != h) ? d : e;
+      out0[x * 2 + 1] = (b == f && b != d && f != h) ? f : e;
+      out1[x * 2] = (d == h && d != b && h != f) ? d : e;
+      out1[x * 2 + 1] = (h == f && d != h && b != f) ? f : e;
+    };
+
+    int x = 0;
+    scalePixel(x++);
+
+#if defined(__SSE2__)
+    // four pixels at a time away from the edges
+    for (; x + 4 < width; x += 4) {
+      __m128i b = _mm_loadu_si128((const __m128i *)(above + x));
+      __m128i h = _mm_loadu_si128((const __m128i *)(below + x));
+      __m128i e = _mm_loadu_si128((const __m128i *)(row + x));
+      __m128i d = _mm_loadu_si128((const __m128i *)(row + x - 1));
+      __m128i f = _mm_loadu_si128((const __m128i *)(row + x + 1));
+
+      __m128i eqDB = _mm_cmpeq_epi32(d, b);
+      __m128i eqBF = _mm_cmpeq_epi32(b, f);
+      __m128i eqDH = _mm_cmpeq_epi32(d, h);
+      __m128i eqHF = _mm_cmpeq_epi32(h, f);
+
+      __m128i m0 = _mm_andnot_si128(_mm_or_si128(eqBF, eqDH), eqDB);
+      __m128i m1 = _mm_andnot_si128(_mm_or_si128(eqDB, eqHF), eqBF);
+      __m128i m2 = _mm_andnot_si128(_mm_or_si128(eqDB, eqHF), eqDH);
+      __m128i m3 = _mm_andnot_si128(_mm_or_si128(eqDH, eqBF), eqHF);
+
+      __m128i e0 = _mm_or_si128(_mm_and_si128(m0, d), _mm_andnot_si128(m0, e));
+      __m128i e1 = _mm_or_si128(_mm_and_si128(m1, f), _mm_andnot_si128(m1, e));
+      __m128i e2 = _mm_or_si128(_mm_and_si128(m2, d), _mm_andnot_si128(m2, e));
+      __m128i e3 = _mm_or_si128(_mm_and_si128(m3, f), _mm_andnot_si128(m3, e));
+
+      _mm_storeu_si128((__m128i *)(out0 + x * 2), _mm_unpacklo_epi32(e0, e1));
+      _mm_storeu_si128((__m128i *)(out0 + x * 2 + 4),
+                       _mm_unpackhi_epi32(e0, e1));
+      _mm_storeu_si128((__m128i *)(out1 + x * 2), _mm_unpacklo_epi32(e2, e3));
+      _mm_storeu_si128((__m128i *)(out1 + x * 2 + 4),
+                       _mm_unpackhi_epi32(e2, e3));
+    }
+#endif
+
+    for (; x < width; ++x) scalePixel(x);
+  }
+}
+
+// scale3x, same edge rules as scale2x extended
+// to a three by three block per pixel
+void Filter::scale3x(const QImage &src, QImage &dst, int startY, int endY) {
+  for (int y = startY; y < endY; ++y) {
+    uint *out0 = rowAt(dst, y * 3);
+    uint *out1 = rowAt(dst, y * 3 + 1);
+    uint *out2 = rowAt(dst, y * 3 + 2);
+    for (int x = 0; x < src.width(); ++x) {
+      uint a = pixelAt(src, x - 1, y - 1), b = pixelAt(src, x, y - 1),
+           c = pixelAt(src, x + 1, y - 1), d = pixelAt(src, x - 1, y),
+           e = pixelAt(src, x, y), f = pixelAt(src, x + 1, y),
+           g = pixelAt(src, x - 1, y + 1), h = pixelAt(src, x, y + 1),
+           i = pixelAt(src, x + 1, y + 1);
+
+      bool edgeDB = d == b && d != h && b != f;
+      bool edgeBF = b == f && b != d && f != h;
+      bool edgeDH = d == h && d != b && h != f;
+      bool edgeHF = h == f && d != h && b != f;
+
+      out0[x * 3] = edgeDB ? d : e;
+      out0[x * 3 + 1] = (edgeDB && e != c) || (edgeBF && e != a) ? b : e;
+      out0[x * 3 + 2] = edgeBF ? f : e;
+      out1[x * 3] = (edgeDB && e != g) || (edgeDH && e != a) ? d : e;
+      out1[x * 3 + 1] = e;
+      out1[x * 3 + 2] = (edgeBF && e != i) || (edgeHF && e != c) ? f : e;
+      out2[x * 3] = edgeDH ? d : e;
+      out2[x * 3 + 1] = (edgeDH && e != i) || (edgeHF && e != g) ? h : e;
+      out2[x * 3 + 2] = edgeHF ? f : e;
+    }
+  }
+}
+
+// hq2x style filter, compares neighbors in yuv
+// space and blends corners instead of replacing
+// them, without the full hqx pattern table
+void Filter::hq2x(const QImage &src, QImage &dst, int startY, int endY) {
+  // blend corner pixel e towards neighbors,
+  // sides are the two edge neighbors next to
+  // the corner and diag is the corner neighbor
+  auto corner = [](uint e, uint side0, uint side1, uint diag) {
+    if (similar(side0, side1) && !similar(e, side0)) {
+      return blend(e, side0, side1, 2, 1, 1);
+    } else if (!similar(e, diag) && !similar(e, side0) &&
+               !similar(e, side1)) {
+      return blend(e, diag, 3, 1);
+    }
+    return e;
+  };
+
+  for (int y = startY; y < endY; ++y) {
+    uint *out0 = rowAt(dst, y * 2);
+    uint *out1 = rowAt(dst, y * 2 + 1);
+    for (int x = 0; x < src.width(); ++x) {
+      uint a = pixelAt(src, x - 1, y - 1), b = pixelAt(src, x, y - 1),
+           c = pixelAt(src, x + 1, y - 1), d = pixelAt(src, x - 1, y),
+           e = pixelAt(src, x, y), f = pixelAt(src, x + 1, y),
+           g = pixelAt(src, x - 1, y + 1), h = pixelAt(src, x, y + 1),
+           i = pixelAt(src, x + 1, y + 1);
+
+      out0[x * 2] = corner(e, d, b, a);
+      out0[x * 2 + 1] = corner(e, b, f, c);
+      out1[x * 2] = corner(e, h, d, g);
+      out1[x * 2 + 1] = corner(e, f, h, i);
+    }
+  }
+}
+
+// xbr style filter (level 1), each output corner
+// is blended with a neighbor when edge detection
+// over the 5x5 neighborhood finds an edge
+// crossing that corner
+void Filter::xbr2x(const QImage &src, QImage &dst, int startY, int endY) {
+  // neighborhood n is indexed [row][col] with
+  // e at [2][2], the bottom right corner is
+  // computed and other corners are mirrored
+  auto corner = [](const uint n[5][5]) {
+    uint b = n[1][2], c = n[1][3], d = n[2][1], e = n[2][2], f = n[2][3],
+         g = n[3][1], h = n[3][2], i = n[3][3], f4 = n[2][4], i4 = n[3][4],
+         h5 = n[4][2], i5 = n[4][3];
+    if (e == f || e == h) return e;
+
+    int edgeWeight = distance(e, c) + distance(e, g) + distance(i, f4) +
+                     distance(i, h5) + 4 * distance(h, f);
+    int diagWeight = distance(h, d) + distance(h, i5) + distance(f, i4) +
+                     distance(f, b) + 4 * distance(e, i);
+    if (edgeWeight >= diagWeight) return e;
+
+    uint px = distance(e, f) <= distance(e, h) ? f : h;
+    return blend(e, px, 1, 1);
+  };
+
+  uint n[5][5], mirrored[5][5];
+  for (int y = startY; y < endY; ++y) {
+    uint *out0 = rowAt(dst, y * 2);
+    uint *out1 = rowAt(dst, y * 2 + 1);
+    for (int x = 0; x < src.width(); ++x) {
+      for (int row = 0; row < 5; ++row) {
+        for (int col = 0; col < 5; ++col) {
+          n[row][col] = pixelAt(src, x + col - 2, y + row - 2);
+        }
+      }
+
+      // mirror neighborhood so each corner
+      // becomes the bottom right corner
+      for (int cornerIdx = 0; cornerIdx < 4; ++cornerIdx) {
+        bool flipX = !(cornerIdx & 1);
+        bool flipY = !(cornerIdx & 2);
+        for (int row = 0; row < 5; ++row) {
+          for (int col = 0; col < 5; ++col) {
+            mirrored[row][col] = n[flipY ? 4 - row : row][flipX ? 4 - col : col];
+          }
+        }
+        uint *out = cornerIdx & 2 ? out1 : out0;
+        out[x * 2 + (cornerIdx & 1)] = corner(mirrored);
+      }
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QImage>
+#include <memory>
+
+#include "../emulator/workerpool.h"
+
+// source rows filtered per worker job
+#define FILTER_BAND_ROWS 16
+
+using namespace std;
+
+enum FilterType { NO_FILTER, SCALE2X, SCALE3X, HQ2X, XBR2X };
+
+// pixel art upscaling filters applied to completed
+// frames before they are presented, each frame is
+// split into horizontal bands filtered in parallel
+class Filter {
+ private:
+  QImage output;
+  unique_ptr<WorkerPool> workerPool;
+
+  // filter functions, each filters source rows
+  // [startY, endY) into the output image
+  static void scale2x(const QImage &src, QImage &dst, int startY, int endY);
+  static void scale3x(const QImage &src, QImage &dst, int startY, int endY);
+  static void hq2x(const QImage &src, QImage &dst, int startY, int endY);
+  static void xbr2x(const QImage &src, QImage &dst, int startY, int endY);
+
+ public:
+  FilterType type;
+
+  Filter();
+
+  const QImage &apply(const QImage &frame);
+  static int scale(FilterType type);
+};
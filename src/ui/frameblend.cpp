@@ -0,0 +1,75 @@
+#include "frameblend.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+FrameBlend::FrameBlend() : history(), primed(false), decay(FRAME_BLEND_OFF) {}
+
+// blend frame into the history and return the
+// history, the returned image is the frame
+// itself when blending is off
+const QImage &FrameBlend::apply(const QImage &frame) {
+  if (decay <= 0) {
+    primed = false;
+    return frame;
+  }
+
+  // restart history from the current frame
+  if (!primed || history.size() != frame.size() ||
+      history.format() != frame.format()) {
+    history = frame.copy();
+    primed = true;
+    return history;
+  }
+
+  int historyWeight = (int)(decay * 256);
+  for (int y = 0; y < frame.height(); ++y) {
+    blendRow((uint *)history.scanLine(y), (const uint *)frame.constScanLine(y),
+             frame.width(), historyWeight);
+  }
+  return history;
+}
+
+// history = (history * weight + frame * (256 - weight)) / 256
+// per channel, rounded to nearest
+void FrameBlend::blendRow(uint *history, const uint *frame, int width,
+                          int historyWeight) {
+  int frameWeight = 256 - historyWeight;
+  int px = 0;
+
+#if defined(__SSE2__)
+  // four pixels at a time, channels are widened
+  // to 16 bits so the weighted sum cannot overflow
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i hWeight = _mm_set1_epi16(historyWeight);
+  const __m128i fWeight = _mm_set1_epi16(frameWeight);
+  for (; px + 4 <= width; px += 4) {
+    __m128i h = _mm_loadu_si128((const __m128i *)(history + px));
+    __m128i f = _mm_loadu_si128((const __m128i *)(frame + px));
+
+    __m128i lo = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(h, zero), hWeight),
+        _mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), fWeight));
+    __m128i hi = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(h, zero), hWeight),
+        _mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), fWeight));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+
+    _mm_storeu_si128((__m128i *)(history + px), _mm_packus_epi16(lo, hi));
+  }
+#endif
+
+  for (; px < width; ++px) {
+    uint color = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      uint channel = (((history[px] >> shift) & 0xFF) * historyWeight +
+                      ((frame[px] >> shift) & 0xFF) * frameWeight + 128) >>
+                     8;
+      color |= channel << shift;
+    }
+    history[px] = color;
+  }
+}
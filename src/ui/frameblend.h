@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QImage>
+
+// decay factors for the frame blend menu options
+#define FRAME_BLEND_OFF 0.0
+#define FRAME_BLEND_LIGHT 0.25
+#define FRAME_BLEND_MEDIUM 0.5
+#define FRAME_BLEND_STRONG 0.75
+
+// simulates lcd persistence by mixing each frame
+// with an exponentially decayed history of the
+// previous frames, decay is the fraction of the
+// history kept each frame
+class FrameBlend {
+ private:
+  QImage history;
+  bool primed;
+
+  static void blendRow(uint *history, const uint *frame, int width,
+                       int historyWeight);
+
+ public:
+  float decay;
+
+  FrameBlend();
+
+  const QImage &apply(const QImage &frame);
+};
@@ -1,5 +1,8 @@
 #include "mainwindow.h"
 
+#include <QDir>
+#include <QFileInfo>
+#include <QMessageBox>
 #include <map>
 
 #include "../emulator/log.h"
@@ -13,13 +16,28 @@ MainWindow::MainWindow(QWidget *parent)
       ui(new Ui::MainWindow),
       cgb(),
       kbWin(&cgb.controls),
-      vramViewer(&cgb) {
+      vramViewer(&cgb),
+      audioOutput(&cgb.apu) {
   ui->setupUi(this);
 
   // **************************************************
   // File Menu
   // **************************************************
   connect(ui->actionOpenROM, &QAction::triggered, this, &MainWindow::loadROM);
+  connect(ui->actionSaveState, &QAction::triggered, this,
+          &MainWindow::saveState);
+  connect(ui->actionLoadState, &QAction::triggered, this,
+          &MainWindow::loadState);
+
+  // movie options
+  connect(ui->actionRecordMoviePowerOn, &QAction::triggered, &cgb,
+          [this] { cgb.recordMovie(true); });
+  connect(ui->actionRecordMovieState, &QAction::triggered, &cgb,
+          [this] { cgb.recordMovie(false); });
+  connect(ui->actionPlayMovie, &QAction::triggered, this,
+          &MainWindow::playMovie);
+  connect(ui->actionStopMovie, &QAction::triggered, this,
+          &MainWindow::stopMovie);
   connect(ui->actionQuit, &QAction::triggered, this, &QApplication::quit);
 
   // **************************************************
@@ -39,6 +57,42 @@ MainWindow::MainWindow(QWidget *parent)
 
   connect(ui->actionSkipDmgBootstrap, &QAction::toggled, &cgb,
           &CGB::toggleDmgBootstrap);
+  connect(ui->actionFastBoot, &QAction::toggled, &cgb, &CGB::toggleFastBoot);
+
+  // frame skip options
+  auto frameSkipGroup = new QActionGroup(this);
+  frameSkipGroup->setExclusive(true);
+  ui->actionFrameSkipOff->setActionGroup(frameSkipGroup);
+  ui->actionFrameSkip1->setActionGroup(frameSkipGroup);
+  ui->actionFrameSkip2->setActionGroup(frameSkipGroup);
+  ui->actionFrameSkip3->setActionGroup(frameSkipGroup);
+  ui->actionFrameSkipAuto->setActionGroup(frameSkipGroup);
+  connect(ui->actionFrameSkipOff, &QAction::triggered, &cgb,
+          [this] { cgb.setFrameSkip(0); });
+  connect(ui->actionFrameSkip1, &QAction::triggered, &cgb,
+          [this] { cgb.setFrameSkip(1); });
+  connect(ui->actionFrameSkip2, &QAction::triggered, &cgb,
+          [this] { cgb.setFrameSkip(2); });
+  connect(ui->actionFrameSkip3, &QAction::triggered, &cgb,
+          [this] { cgb.setFrameSkip(3); });
+  connect(ui->actionFrameSkipAuto, &QAction::triggered, &cgb,
+          [this] { cgb.setFrameSkip(AUTO_FRAME_SKIP); });
+
+  // run ahead options
+  auto runAheadGroup = new QActionGroup(this);
+  runAheadGroup->setExclusive(true);
+  ui->actionRunAheadOff->setActionGroup(runAheadGroup);
+  ui->actionRunAhead1->setActionGroup(runAheadGroup);
+  ui->actionRunAhead2->setActionGroup(runAheadGroup);
+  ui->actionRunAhead3->setActionGroup(runAheadGroup);
+  connect(ui->actionRunAheadOff, &QAction::triggered, &cgb,
+          [this] { cgb.setRunAhead(0); });
+  connect(ui->actionRunAhead1, &QAction::triggered, &cgb,
+          [this] { cgb.setRunAhead(1); });
+  connect(ui->actionRunAhead2, &QAction::triggered, &cgb,
+          [this] { cgb.setRunAhead(2); });
+  connect(ui->actionRunAhead3, &QAction::triggered, &cgb,
+          [this] { cgb.setRunAhead(3); });
 
   // **************************************************
   // Display Menu
@@ -56,6 +110,41 @@ MainWindow::MainWindow(QWidget *parent)
   connect(ui->action1_5x, &QAction::triggered, this, [this] { setScale(1.5); });
   connect(ui->action2x, &QAction::triggered, this, [this] { setScale(2.0); });
 
+  // filter options
+  auto filterGroup = new QActionGroup(this);
+  filterGroup->setExclusive(true);
+  ui->actionFilterNone->setActionGroup(filterGroup);
+  ui->actionFilterScale2x->setActionGroup(filterGroup);
+  ui->actionFilterScale3x->setActionGroup(filterGroup);
+  ui->actionFilterHq2x->setActionGroup(filterGroup);
+  ui->actionFilterXbr2x->setActionGroup(filterGroup);
+  connect(ui->actionFilterNone, &QAction::triggered, this,
+          [this] { setFilter(NO_FILTER); });
+  connect(ui->actionFilterScale2x, &QAction::triggered, this,
+          [this] { setFilter(SCALE2X); });
+  connect(ui->actionFilterScale3x, &QAction::triggered, this,
+          [this] { setFilter(SCALE3X); });
+  connect(ui->actionFilterHq2x, &QAction::triggered, this,
+          [this] { setFilter(HQ2X); });
+  connect(ui->actionFilterXbr2x, &QAction::triggered, this,
+          [this] { setFilter(XBR2X); });
+
+  // frame blend options
+  auto frameBlendGroup = new QActionGroup(this);
+  frameBlendGroup->setExclusive(true);
+  ui->actionFrameBlendOff->setActionGroup(frameBlendGroup);
+  ui->actionFrameBlendLight->setActionGroup(frameBlendGroup);
+  ui->actionFrameBlendMedium->setActionGroup(frameBlendGroup);
+  ui->actionFrameBlendStrong->setActionGroup(frameBlendGroup);
+  connect(ui->actionFrameBlendOff, &QAction::triggered, this,
+          [this] { setFrameBlend(FRAME_BLEND_OFF); });
+  connect(ui->actionFrameBlendLight, &QAction::triggered, this,
+          [this] { setFrameBlend(FRAME_BLEND_LIGHT); });
+  connect(ui->actionFrameBlendMedium, &QAction::triggered, this,
+          [this] { setFrameBlend(FRAME_BLEND_MEDIUM); });
+  connect(ui->actionFrameBlendStrong, &QAction::triggered, this,
+          [this] { setFrameBlend(FRAME_BLEND_STRONG); });
+
   // palette options
   auto paletteGroup = new QActionGroup(this);
   paletteGroup->setExclusive(true);
@@ -90,6 +179,19 @@ MainWindow::MainWindow(QWidget *parent)
             [this, sgbPalette] { cgb.previewPalette(sgbPalette); });
   }
 
+  // color correction options
+  auto colorGroup = new QActionGroup(this);
+  colorGroup->setExclusive(true);
+  ui->actionColorsRaw->setActionGroup(colorGroup);
+  ui->actionColorsGamma->setActionGroup(colorGroup);
+  ui->actionColorsGbcLcd->setActionGroup(colorGroup);
+  connect(ui->actionColorsRaw, &QAction::triggered, this,
+          [this] { setColorProfile(RAW_COLORS); });
+  connect(ui->actionColorsGamma, &QAction::triggered, this,
+          [this] { setColorProfile(GAMMA_COLORS); });
+  connect(ui->actionColorsGbcLcd, &QAction::triggered, this,
+          [this] { setColorProfile(GBC_LCD_COLORS); });
+
   // reset palette preview
   connect(ui->menuPalette, &QMenu::aboutToHide, &cgb,
           &CGB::resetPreviewPalette);
@@ -100,6 +202,19 @@ MainWindow::MainWindow(QWidget *parent)
   connect(ui->actionShowSprites, &QAction::toggled, &cgb.ppu,
           &PPU::toggleSprites);
 
+  // rendering options
+  auto renderingGroup = new QActionGroup(this);
+  renderingGroup->setExclusive(true);
+  ui->actionRenderInline->setActionGroup(renderingGroup);
+  ui->actionRenderParallel->setActionGroup(renderingGroup);
+  ui->actionRenderPipelined->setActionGroup(renderingGroup);
+  connect(ui->actionRenderInline, &QAction::triggered, &cgb.ppu,
+          [this] { cgb.ppu.setRenderMode(RenderMode::INLINE); });
+  connect(ui->actionRenderParallel, &QAction::triggered, &cgb.ppu,
+          [this] { cgb.ppu.setRenderMode(RenderMode::PARALLEL); });
+  connect(ui->actionRenderPipelined, &QAction::triggered, &cgb.ppu,
+          [this] { cgb.ppu.setRenderMode(RenderMode::PIPELINED); });
+
   // **************************************************
   // Controls Menu
   // **************************************************
@@ -124,6 +239,9 @@ MainWindow::MainWindow(QWidget *parent)
   // Load Settings
   // **************************************************
   Settings::load(this, palNameToAction);
+
+  // start pulling samples from the apu
+  audioOutput.start();
 }
 
 MainWindow::~MainWindow() { delete ui; }
@@ -150,23 +268,90 @@ void MainWindow::loadROM() {
     cgb.romPath = romPath;
     cgb.reset();
     bool romSupported = cgb.loadRom(romPath);
-    if (romSupported) cgb.start(QThread::HighestPriority);
+    if (romSupported) {
+      cgb.start(QThread::HighestPriority);
+    } else {
+      QMessageBox mbox{};
+      auto message =
+          "Bank type " + cgb.mbc.bankTypeStr() + " is not supported";
+      mbox.setText(QString::fromStdString(message));
+      mbox.exec();
+    }
+  }
+}
+
+// save state of the running rom next to the rom
+void MainWindow::saveState() {
+  if (cgb.romPath == QDir::currentPath()) return;
+  if (!cgb.saveStateFile()) {
+    QMessageBox mbox{};
+    mbox.setText("Could not write " + cgb.statePath());
+    mbox.exec();
+  }
+}
+
+// load state of the running rom, the game keeps
+// running unchanged if the state cannot be used
+void MainWindow::loadState() {
+  if (cgb.romPath == QDir::currentPath()) return;
+  if (!cgb.loadStateFile()) {
+    QMessageBox mbox{};
+    mbox.setText("Could not load " + cgb.statePath());
+    mbox.exec();
+  }
+}
+
+// play a movie recorded with the running rom
+void MainWindow::playMovie() {
+  if (cgb.romPath == QDir::currentPath()) return;
+  cgb.pause = true;
+  QString moviePath = QFileDialog::getOpenFileName(
+      this, tr("Play Movie"), moviePathForRom(),
+      tr("Movies (*" MOVIE_EXTENSION ")"));
+  cgb.pause = false;
+  if (moviePath != "" && !cgb.playMovieFile(moviePath)) {
+    QMessageBox mbox{};
+    mbox.setText("Could not play " + moviePath);
+    mbox.exec();
   }
 }
 
+// stop the movie, a recording is saved to
+// the chosen file
+void MainWindow::stopMovie() {
+  bool recording = cgb.movie.mode == MOVIE_RECORDING;
+  cgb.stopMovie();
+  if (!recording) return;
+
+  cgb.pause = true;
+  QString moviePath = QFileDialog::getSaveFileName(
+      this, tr("Save Movie"), moviePathForRom(),
+      tr("Movies (*" MOVIE_EXTENSION ")"));
+  cgb.pause = false;
+  if (moviePath != "" && !cgb.movie.save(moviePath)) {
+    QMessageBox mbox{};
+    mbox.setText("Could not write " + moviePath);
+    mbox.exec();
+  }
+}
+
+// movies are offered next to the rom by default
+QString MainWindow::moviePathForRom() const {
+  QFileInfo romInfo(cgb.romPath);
+  return romInfo.path() + "/" + romInfo.completeBaseName() + MOVIE_EXTENSION;
+}
+
 // **************************************************
 // **************************************************
 // QT Slots
 // **************************************************
 // **************************************************
 
-// set screen to the given image
-void MainWindow::setScreen(const QImage *image) {
-  // no anti-aliasing when resizing image
-  auto pixmap = QPixmap::fromImage(*image).scaled(
-      ui->screen->width(), ui->screen->height(), Qt::KeepAspectRatio,
-      Qt::FastTransformation);
-  ui->screen->setPixmap(pixmap);
+// set screen to the newest frame
+// completed by the ppu
+void MainWindow::setScreen() {
+  const QImage *frame = cgb.frameBuffer.acquire();
+  ui->screen->present(*frame, cgb.frameBuffer.frontHash());
 }
 
 // set screen scale
@@ -179,9 +364,25 @@ void MainWindow::setScale(float scale) {
   this->setFixedSize(width, height + ui->menubar->height());
 #endif
   ui->screen->setFixedSize(width, height);
+  cgb.renderInPauseMode();
   Settings::saveScale(scale);
 }
 
+// set filter applied to frames before
+// they are scaled to the screen
+void MainWindow::setFilter(FilterType type) {
+  ui->screen->filter.type = type;
+  cgb.renderInPauseMode();
+  Settings::saveFilter(type);
+}
+
+// set how much of the previous frames
+// is blended into each new frame
+void MainWindow::setFrameBlend(float decay) {
+  ui->screen->frameBlend.decay = decay;
+  Settings::saveFrameBlend(decay);
+}
+
 // set dmg palette
 void MainWindow::setPalette(Palette *palette) {
   cgb.ppu.palette = palette;
@@ -190,6 +391,13 @@ void MainWindow::setPalette(Palette *palette) {
   Settings::savePalette(palette);
 }
 
+// set color correction for cgb colors
+void MainWindow::setColorProfile(ColorProfile profile) {
+  cgb.ppu.setColorProfile(profile);
+  cgb.renderInPauseMode();
+  Settings::saveColorProfile(profile);
+}
+
 // open the key bindings window
 void MainWindow::openKeyBindingsWindow() {
   kbWin.refreshKeyLabels();
@@ -202,15 +410,24 @@ void MainWindow::openVramViewer() { vramViewer.show(); }
 // toggle logging
 void MainWindow::toggleLogging(bool enableLog) { Log::enable = enableLog; }
 
-// game boy button press event
+// game boy button press event, the game
+// rewinds while the rewind key is held
 void MainWindow::keyPressEvent(QKeyEvent *event) {
-  cgb.controls.press(event->key());
+  if (event->key() == REWIND_KEY) {
+    cgb.rewinding = true;
+  } else {
+    cgb.controls.press(event->key());
+  }
 }
 
 // game boy button release event
 void MainWindow::keyReleaseEvent(QKeyEvent *event) {
   if (!event->isAutoRepeat()) {
-    cgb.controls.release(event->key());
+    if (event->key() == REWIND_KEY) {
+      cgb.rewinding = false;
+    } else {
+      cgb.controls.release(event->key());
+    }
   }
 }
 
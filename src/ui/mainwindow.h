@@ -10,12 +10,15 @@
 
 #include "../emulator/cgb.h"
 #include "./ui_mainwindow.h"
+#include "audiooutput.h"
+#include "filters.h"
 #include "keybindingswindow.h"
 #include "palettes.h"
 #include "vramviewer.h"
 
 #define WINDOW_BASE_WIDTH 640
 #define WINDOW_BASE_HEIGHT 576
+#define REWIND_KEY Qt::Key_Backspace
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -35,9 +38,16 @@ class MainWindow : public QMainWindow {
 
  public slots:
   void loadROM();
-  void setScreen(const QImage *image);
+  void saveState();
+  void loadState();
+  void playMovie();
+  void stopMovie();
+  void setScreen();
   void setPalette(Palette *palette);
+  void setColorProfile(ColorProfile profile);
   void setScale(float scale);
+  void setFilter(FilterType type);
+  void setFrameBlend(float decay);
   void openKeyBindingsWindow();
   void openVramViewer();
   void toggleLogging(bool enableLog);
@@ -50,6 +60,8 @@ class MainWindow : public QMainWindow {
  private:
   KeyBindingsWindow kbWin;
   VramViewer vramViewer;
+  AudioOutput audioOutput;
 
   QString getPaletteLabel(Palette *palette);
+  QString moviePathForRom() const;
 };
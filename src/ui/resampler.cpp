@@ -0,0 +1,142 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// history holds one block of input at the
+// given ratio along with the filter taps
+#define HISTORY_FRAMES(ratio) \
+  (RESAMPLER_BLOCK_FRAMES * (size_t)ceil(ratio) + RESAMPLER_TAPS + 2)
+
+Resampler::Resampler()
+    : kernel(RESAMPLER_PHASES * RESAMPLER_TAPS),
+      history{vector<float>(HISTORY_FRAMES(1)),
+              vector<float>(HISTORY_FRAMES(1))},
+      historyFrames(RESAMPLER_TAPS),
+      historyCapacity(HISTORY_FRAMES(1)),
+      position(0),
+      lastFrame() {}
+
+// build filter bank with the cutoff lowered below
+// the output nyquist frequency when downsampling,
+// each phase is normalized to unity gain, history
+// is sized for the largest ratio process is given
+void Resampler::configure(int inputRate, int outputRate, double maxRatio) {
+  const double pi = acos(-1.0);
+  double cutoff = RESAMPLER_CUTOFF * min(1.0, (double)outputRate / inputRate);
+
+  for (int phase = 0; phase < RESAMPLER_PHASES; ++phase) {
+    float *taps = &kernel[phase * RESAMPLER_TAPS];
+    double sum = 0;
+    for (int i = 0; i < RESAMPLER_TAPS; ++i) {
+      double x = i - (RESAMPLER_TAPS / 2 - 1) - (double)phase / RESAMPLER_PHASES;
+      double t = pi * x * cutoff;
+      double sinc = t == 0 ? 1 : sin(t) / t;
+      double window = 0.42 + 0.5 * cos(pi * x / (RESAMPLER_TAPS / 2)) +
+                      0.08 * cos(2 * pi * x / (RESAMPLER_TAPS / 2));
+      taps[i] = sinc * window;
+      sum += taps[i];
+    }
+    for (int i = 0; i < RESAMPLER_TAPS; ++i) taps[i] /= sum;
+  }
+
+  // restart from silence
+  historyCapacity = HISTORY_FRAMES(max(maxRatio, 1.0));
+  for (auto &channel : history) channel.assign(historyCapacity, 0);
+  historyFrames = RESAMPLER_TAPS;
+  position = 0;
+  fill(lastFrame, lastFrame + 2, 0);
+}
+
+// input frames the history can hold
+size_t Resampler::capacity() const { return historyCapacity; }
+
+// input frames to push before outputFrames
+// can be produced at the given ratio
+size_t Resampler::inputFrames(size_t outputFrames, double ratio) const {
+  if (outputFrames == 0) return 0;
+  size_t end = position + (outputFrames - 1) * ratio;
+  size_t needed = end + RESAMPLER_TAPS;
+  return needed > historyFrames ? needed - historyFrames : 0;
+}
+
+// append interleaved stereo frames to the history
+void Resampler::push(const int16 *frames, size_t count) {
+  count = min(count, historyCapacity - historyFrames);
+  for (size_t i = 0; i < count; ++i) {
+    history[0][historyFrames + i] = frames[i * 2];
+    history[1][historyFrames + i] = frames[i * 2 + 1];
+  }
+  historyFrames += count;
+  if (count > 0) copy(frames + (count - 1) * 2, frames + count * 2, lastFrame);
+}
+
+// repeat the last frame, used when the
+// input runs dry so the output holds level
+void Resampler::pad(size_t count) {
+  count = min(count, historyCapacity - historyFrames);
+  fill_n(&history[0][historyFrames], count, lastFrame[0]);
+  fill_n(&history[1][historyFrames], count, lastFrame[1]);
+  historyFrames += count;
+}
+
+// frames that cannot be produced from
+// the history are output as silence
+void Resampler::process(int16 *out, size_t outputFrames, double ratio) {
+  size_t i = 0;
+  for (; i < outputFrames; ++i) {
+    size_t first = position;
+    if (first + RESAMPLER_TAPS > historyFrames) break;
+    int phase = (position - first) * RESAMPLER_PHASES;
+    const float *taps = &kernel[phase * RESAMPLER_TAPS];
+
+    for (int ch = 0; ch < 2; ++ch) {
+      float sample = dot(&history[ch][first], taps);
+      *out++ = (int16)clamp(sample, -32768.0f, 32767.0f);
+    }
+    position += ratio;
+  }
+  fill_n(out, (outputFrames - i) * 2, 0);
+
+  // drop consumed history
+  size_t consumed = min((size_t)position, historyFrames);
+  for (auto &channel : history) {
+    memmove(channel.data(), channel.data() + consumed,
+            (historyFrames - consumed) * sizeof(float));
+  }
+  historyFrames -= consumed;
+  position -= consumed;
+}
+
+float Resampler::dot(const float *samples, const float *taps) {
+#if defined(__AVX__)
+  __m256 sum = _mm256_setzero_ps();
+  for (int i = 0; i < RESAMPLER_TAPS; i += 8) {
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(samples + i),
+                                           _mm256_loadu_ps(taps + i)));
+  }
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                           _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  return _mm_cvtss_f32(half);
+#elif defined(__SSE2__)
+  __m128 sum = _mm_setzero_ps();
+  for (int i = 0; i < RESAMPLER_TAPS; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(samples + i),
+                                     _mm_loadu_ps(taps + i)));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+#else
+  float sum = 0;
+  for (int i = 0; i < RESAMPLER_TAPS; ++i) sum += samples[i] * taps[i];
+  return sum;
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "../emulator/types.h"
+
+using namespace std;
+
+// windowed sinc filter bank, each output frame uses
+// the nearest of RESAMPLER_PHASES kernels so no trig
+// is evaluated per sample
+#define RESAMPLER_TAPS 16
+#define RESAMPLER_PHASES 256
+#define RESAMPLER_CUTOFF 0.9
+#define RESAMPLER_BLOCK_FRAMES 256
+
+// polyphase resampler for interleaved stereo, input
+// is kept as planar float history so each output
+// frame is two dot products over contiguous taps
+class Resampler {
+ private:
+  vector<float> kernel;
+  vector<float> history[2];
+  size_t historyFrames;
+  size_t historyCapacity;
+  double position;
+  int16 lastFrame[2];
+
+  static float dot(const float *samples, const float *taps);
+
+ public:
+  Resampler();
+
+  void configure(int inputRate, int outputRate, double maxRatio);
+  size_t capacity() const;
+  size_t inputFrames(size_t outputFrames, double ratio) const;
+  void push(const int16 *frames, size_t count);
+  void pad(size_t count);
+  void process(int16 *out, size_t outputFrames, double ratio);
+};
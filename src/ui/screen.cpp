@@ -0,0 +1,162 @@
+#include "screen.h"
+
+#include <QPainter>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+Screen::Screen(QWidget *parent)
+    : QWidget(parent),
+      frameBlend(),
+      filter(),
+      background(":/assets/imgs/background.png"),
+      output(),
+      scaleFactor(0),
+      hasFrame(false),
+      presentedHash(0),
+      presentedSize(),
+      presentedFilter(NO_FILTER) {
+  // every pixel is painted on each update
+  setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+// blend, filter and scale frame into the output
+// buffer and schedule a repaint, filters whose
+// output would not fit the widget are skipped
+void Screen::present(const QImage &frame, uint64 frameHash) {
+  // skip frames identical to the one on screen,
+  // blended frames keep changing as the history fades
+  if (hasFrame && frameHash == presentedHash && size() == presentedSize &&
+      filter.type == presentedFilter && frameBlend.decay <= 0) {
+    return;
+  }
+  presentedHash = frameHash;
+  presentedSize = size();
+  presentedFilter = filter.type;
+
+  const QImage &blended = frameBlend.apply(frame);
+
+  int filterScale = Filter::scale(filter.type);
+  bool filterFits = frame.width() * filterScale <= width() &&
+                    frame.height() * filterScale <= height();
+  const QImage &filtered = filterFits ? filter.apply(blended) : blended;
+
+  int factor =
+      max(min(width() / filtered.width(), height() / filtered.height()), 1);
+  if (factor != scaleFactor || output.width() != filtered.width() * factor ||
+      output.format() != filtered.format()) {
+    scaleFactor = factor;
+    output = QImage(filtered.width() * factor, filtered.height() * factor,
+                    filtered.format());
+  }
+  scaleFrame(filtered);
+  hasFrame = true;
+  update();
+}
+
+// draw output buffer centered in the widget,
+// the boot background is shown until the first
+// frame is presented
+void Screen::paintEvent(QPaintEvent *event) {
+  Q_UNUSED(event);
+  QPainter painter(this);
+  if (!hasFrame) {
+    painter.drawImage(rect(), background);
+    return;
+  }
+
+  int x = (width() - output.width()) / 2;
+  int y = (height() - output.height()) / 2;
+  if (x > 0 || y > 0) painter.fillRect(rect(), Qt::black);
+  painter.drawImage(x, y, output);
+}
+
+// nearest neighbor scale by replicating pixels
+// horizontally and then copying whole rows
+void Screen::scaleFrame(const QImage &frame) {
+  int srcWidth = frame.width();
+  int dstWidth = output.width();
+  int dstStride = output.bytesPerLine();
+  uchar *dstBits = output.bits();
+
+  for (int y = 0; y < frame.height(); ++y) {
+    auto src = (const uint *)frame.constScanLine(y);
+    auto dst = (uint *)(dstBits + y * scaleFactor * dstStride);
+    scaleRow(src, dst, srcWidth, scaleFactor);
+    for (int row = 1; row < scaleFactor; ++row) {
+      memcpy(dstBits + (y * scaleFactor + row) * dstStride, dst,
+             dstWidth * sizeof(uint));
+    }
+  }
+}
+
+// replicate each pixel of a row factor times,
+// vector paths are used where available and
+// the scalar loop finishes any remaining pixels
+void Screen::scaleRow(const uint *src, uint *dst, int width, int factor) {
+  int px = 0;
+
+#if defined(__AVX2__)
+  if (factor == 2) {
+    const __m256i loIdx = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i hiIdx = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    for (; px + 8 <= width; px += 8) {
+      __m256i in = _mm256_loadu_si256((const __m256i *)(src + px));
+      __m256i *out = (__m256i *)(dst + px * 2);
+      _mm256_storeu_si256(out, _mm256_permutevar8x32_epi32(in, loIdx));
+      _mm256_storeu_si256(out + 1, _mm256_permutevar8x32_epi32(in, hiIdx));
+    }
+  } else if (factor >= 8) {
+    for (; px < width; ++px) {
+      __m256i color = _mm256_set1_epi32(src[px]);
+      uint *out = dst + px * factor;
+      int i = 0;
+      for (; i + 8 <= factor; i += 8) {
+        _mm256_storeu_si256((__m256i *)(out + i), color);
+      }
+      for (; i < factor; ++i) out[i] = src[px];
+    }
+  }
+#endif
+
+#if defined(__SSE2__)
+  if (factor == 2) {
+    for (; px + 4 <= width; px += 4) {
+      __m128i in = _mm_loadu_si128((const __m128i *)(src + px));
+      __m128i *out = (__m128i *)(dst + px * 2);
+      _mm_storeu_si128(out, _mm_unpacklo_epi32(in, in));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(in, in));
+    }
+  } else if (factor == 3) {
+    for (; px + 4 <= width; px += 4) {
+      __m128i in = _mm_loadu_si128((const __m128i *)(src + px));
+      __m128i *out = (__m128i *)(dst + px * 3);
+      _mm_storeu_si128(out, _mm_shuffle_epi32(in, _MM_SHUFFLE(1, 0, 0, 0)));
+      _mm_storeu_si128(out + 1,
+                       _mm_shuffle_epi32(in, _MM_SHUFFLE(2, 2, 1, 1)));
+      _mm_storeu_si128(out + 2,
+                       _mm_shuffle_epi32(in, _MM_SHUFFLE(3, 3, 3, 2)));
+    }
+  } else if (factor >= 4) {
+    for (; px < width; ++px) {
+      __m128i color = _mm_set1_epi32(src[px]);
+      uint *out = dst + px * factor;
+      int i = 0;
+      for (; i + 4 <= factor; i += 4) {
+        _mm_storeu_si128((__m128i *)(out + i), color);
+      }
+      for (; i < factor; ++i) out[i] = src[px];
+    }
+  }
+#endif
+
+  for (; px < width; ++px) {
+    uint *out = dst + px * factor;
+    for (int i = 0; i < factor; ++i) out[i] = src[px];
+  }
+}
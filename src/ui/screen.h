@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QImage>
+#include <QPaintEvent>
+#include <QWidget>
+
+#include "../emulator/types.h"
+#include "filters.h"
+#include "frameblend.h"
+
+// widget that presents emulator frames, each frame
+// is scaled by the largest integer factor that fits
+// the widget into a buffer that is only reallocated
+// when the scale factor changes
+class Screen : public QWidget {
+  Q_OBJECT
+
+ public:
+  FrameBlend frameBlend;
+  Filter filter;
+
+  explicit Screen(QWidget *parent = nullptr);
+
+  void present(const QImage &frame, uint64 frameHash);
+
+ protected:
+  void paintEvent(QPaintEvent *event) override;
+
+ private:
+  QImage background;
+  QImage output;
+  int scaleFactor;
+  bool hasFrame;
+
+  // state of the last presented frame, a frame
+  // is only presented again if any of it changed
+  uint64 presentedHash;
+  QSize presentedSize;
+  FilterType presentedFilter;
+
+  void scaleFrame(const QImage &frame);
+  static void scaleRow(const uint *src, uint *dst, int width, int factor);
+};
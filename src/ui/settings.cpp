@@ -1,5 +1,7 @@
 #include "settings.h"
 
+#include <algorithm>
+
 QSettings Settings::settings("PScottZero", "Dot Matrix");
 
 void Settings::saveRomPath(QString path) {
@@ -20,6 +22,30 @@ void Settings::saveSkipDmgBootstrap(bool skip) {
   settings.setValue(SKIP_BOOT_KEY, skip);
 }
 
+void Settings::saveFastBoot(bool fast) {
+  settings.setValue(FAST_BOOT_KEY, fast);
+}
+
+void Settings::saveFrameSkip(int frames) {
+  settings.setValue(FRAME_SKIP_KEY, frames);
+}
+
+void Settings::saveRunAhead(int frames) {
+  settings.setValue(RUN_AHEAD_KEY, frames);
+}
+
+void Settings::saveFilter(FilterType type) {
+  settings.setValue(FILTER_KEY, type);
+}
+
+void Settings::saveFrameBlend(float decay) {
+  settings.setValue(FRAME_BLEND_KEY, decay);
+}
+
+void Settings::saveColorProfile(ColorProfile profile) {
+  settings.setValue(COLOR_PROFILE_KEY, profile);
+}
+
 void Settings::saveKeyBinding(int key, Button button) {
   settings.setValue(buttonStr(button), key);
 }
@@ -46,12 +72,55 @@ void Settings::load(MainWindow *mw, map<QString, QAction *> palNameToAction) {
   }
   mw->setScale(scale);
 
+  // set filter setting
+  if (settings.contains(FILTER_KEY)) {
+    auto type = (FilterType)settings.value(FILTER_KEY).toInt();
+    mw->ui->screen->filter.type = type;
+    if (type == SCALE2X) {
+      mw->ui->actionFilterScale2x->setChecked(true);
+    } else if (type == SCALE3X) {
+      mw->ui->actionFilterScale3x->setChecked(true);
+    } else if (type == HQ2X) {
+      mw->ui->actionFilterHq2x->setChecked(true);
+    } else if (type == XBR2X) {
+      mw->ui->actionFilterXbr2x->setChecked(true);
+    }
+  }
+
+  // set frame blend setting
+  if (settings.contains(FRAME_BLEND_KEY)) {
+    float decay = settings.value(FRAME_BLEND_KEY).toFloat();
+    mw->ui->screen->frameBlend.decay = decay;
+    if (decay == (float)FRAME_BLEND_LIGHT) {
+      mw->ui->actionFrameBlendLight->setChecked(true);
+    } else if (decay == (float)FRAME_BLEND_MEDIUM) {
+      mw->ui->actionFrameBlendMedium->setChecked(true);
+    } else if (decay == (float)FRAME_BLEND_STRONG) {
+      mw->ui->actionFrameBlendStrong->setChecked(true);
+    }
+  }
+
   // set palette setting
   if (settings.contains(PALETTE_KEY)) {
     auto palName = settings.value(PALETTE_KEY).toString();
     palNameToAction[palName]->setChecked(true);
   }
 
+  // set color correction setting, unknown
+  // profiles fall back to raw colors
+  if (settings.contains(COLOR_PROFILE_KEY)) {
+    int value = settings.value(COLOR_PROFILE_KEY).toInt();
+    auto profile = value >= 0 && value < COLOR_PROFILE_COUNT
+                       ? (ColorProfile)value
+                       : RAW_COLORS;
+    mw->cgb.ppu.setColorProfile(profile);
+    if (profile == GAMMA_COLORS) {
+      mw->ui->actionColorsGamma->setChecked(true);
+    } else if (profile == GBC_LCD_COLORS) {
+      mw->ui->actionColorsGbcLcd->setChecked(true);
+    }
+  }
+
   // set device setting
   if (settings.contains(DEVICE_KEY)) {
     auto device = settings.value(DEVICE_KEY).toString();
@@ -70,6 +139,45 @@ void Settings::load(MainWindow *mw, map<QString, QAction *> palNameToAction) {
     mw->ui->actionSkipDmgBootstrap->setChecked(skip);
   }
 
+  // set fast boot setting
+  if (settings.contains(FAST_BOOT_KEY)) {
+    bool fast = settings.value(FAST_BOOT_KEY).toBool();
+    mw->cgb.bootstrap.fastBoot = fast;
+    mw->ui->actionFastBoot->setChecked(fast);
+  }
+
+  // set frame skip setting
+  if (settings.contains(FRAME_SKIP_KEY)) {
+    int frames = settings.value(FRAME_SKIP_KEY).toInt();
+    mw->cgb.ppu.autoFrameSkip = frames == AUTO_FRAME_SKIP;
+    mw->cgb.ppu.frameSkip = mw->cgb.ppu.autoFrameSkip ? 0 : frames;
+    if (frames == AUTO_FRAME_SKIP) {
+      mw->ui->actionFrameSkipAuto->setChecked(true);
+    } else if (frames == 1) {
+      mw->ui->actionFrameSkip1->setChecked(true);
+    } else if (frames == 2) {
+      mw->ui->actionFrameSkip2->setChecked(true);
+    } else if (frames == 3) {
+      mw->ui->actionFrameSkip3->setChecked(true);
+    }
+  }
+
+  // set run ahead setting, clamped to
+  // the counts the menu offers
+  if (settings.contains(RUN_AHEAD_KEY)) {
+    int frames = clamp(settings.value(RUN_AHEAD_KEY).toInt(), 0,
+                       MAX_RUN_AHEAD_FRAMES);
+    mw->cgb.runAheadFrames = frames;
+    mw->cgb.ppu.hideFrames = frames > 0;
+    if (frames == 1) {
+      mw->ui->actionRunAhead1->setChecked(true);
+    } else if (frames == 2) {
+      mw->ui->actionRunAhead2->setChecked(true);
+    } else if (frames == 3) {
+      mw->ui->actionRunAhead3->setChecked(true);
+    }
+  }
+
   // key binding settings
   Button buttons[8] = {RIGHT, LEFT, UP, DOWN, A, B, SELECT, START};
   for (auto button : buttons) {
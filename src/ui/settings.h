@@ -11,6 +11,12 @@
 #define PALETTE_KEY "DMG Palette"
 #define DEVICE_KEY "Device"
 #define SKIP_BOOT_KEY "Skip Bootstrap"
+#define FAST_BOOT_KEY "Fast Boot"
+#define FRAME_SKIP_KEY "Frame Skip"
+#define RUN_AHEAD_KEY "Run Ahead"
+#define FILTER_KEY "Filter"
+#define FRAME_BLEND_KEY "Frame Blend"
+#define COLOR_PROFILE_KEY "Color Correction"
 
 using namespace std;
 
@@ -27,6 +33,12 @@ class Settings {
   static void savePalette(Palette *palette);
   static void saveDevice(bool cgb);
   static void saveSkipDmgBootstrap(bool skip);
+  static void saveFastBoot(bool fast);
+  static void saveFrameSkip(int frames);
+  static void saveRunAhead(int frames);
+  static void saveFilter(FilterType type);
+  static void saveFrameBlend(float decay);
+  static void saveColorProfile(ColorProfile profile);
   static void saveKeyBinding(int key, Button button);
 
   // load settings functions
@@ -15,7 +15,17 @@ VramViewer::VramViewer(CGB *cgb, QWidget *parent)
       vramDisplay(TILE_PX_DIM * VIEWER_TILES_PER_ROW,
                   TILE_PX_DIM * VIEWER_TILE_ROWS, QImage::Format_RGB32),
       bgDisplay(BG_PX_DIM, BG_PX_DIM, QImage::Format_RGB32),
-      winDisplay(BG_PX_DIM, BG_PX_DIM, QImage::Format_RGB32) {
+      winDisplay(BG_PX_DIM, BG_PX_DIM, QImage::Format_RGB32),
+      lineScxs(),
+      lineScys(),
+      scxCounts(),
+      scyCounts(),
+      viewportScx(0),
+      viewportScy(0) {
+  // every line starts out scrolled to zero
+  scxCounts[0] = SCREEN_PX_HEIGHT;
+  scyCounts[0] = SCREEN_PX_HEIGHT;
+
   ui->setupUi(this);
   ui->tabWidget->setCurrentIndex(0);
   std::thread renderThread(&VramViewer::render, this);
@@ -23,6 +33,7 @@ VramViewer::VramViewer(CGB *cgb, QWidget *parent)
 }
 
 VramViewer::~VramViewer() {
+  cgb->ppu.detachObserver();
   running = false;
   delete ui;
 }
@@ -128,8 +139,8 @@ void VramViewer::renderTileMap(QImage &display, uint16 tileMapAddr) {
 }
 
 void VramViewer::renderBgViewport() {
-  uint8 scx = cgb->ppu.renderedScx;
-  uint8 scy = cgb->ppu.renderedScy;
+  uint8 scx = viewportScx;
+  uint8 scy = viewportScy;
 
   // top and bottom lines of viewport
   for (uint8 x = 0; x < SCREEN_PX_WIDTH; ++x) {
@@ -153,3 +164,41 @@ void VramViewer::renderBgViewport() {
     bgDisplay.setPixel(rightX, bothY, 0xFF000000 | ~rightColor);
   }
 }
+
+// update scroll counts as the ppu captures each
+// line, called on the emulation thread
+void VramViewer::lineCaptured(const line_state_t &line) {
+  --scxCounts[lineScxs[line.ly]];
+  ++scxCounts[line.scx];
+  lineScxs[line.ly] = line.scx;
+
+  --scyCounts[lineScys[line.ly]];
+  ++scyCounts[line.scy];
+  lineScys[line.ly] = line.scy;
+
+  if (line.ly == SCREEN_PX_HEIGHT - 1) {
+    viewportScx = mostFrequent(scxCounts);
+    viewportScy = mostFrequent(scyCounts);
+  }
+}
+
+// only observe the ppu while visible
+void VramViewer::showEvent(QShowEvent *event) {
+  cgb->ppu.attachObserver(this);
+  QWidget::showEvent(event);
+}
+
+void VramViewer::hideEvent(QHideEvent *event) {
+  cgb->ppu.detachObserver();
+  QWidget::hideEvent(event);
+}
+
+// get scroll value used by the most lines,
+// ties go to the smallest value
+uint8 VramViewer::mostFrequent(const uint8 counts[BG_PX_DIM]) {
+  uint8 value = 0;
+  for (int i = 1; i < BG_PX_DIM; ++i) {
+    if (counts[i] > counts[value]) value = i;
+  }
+  return value;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QWidget>
+#include <atomic>
 
 #include "../emulator/cgb.h"
 
@@ -16,7 +17,7 @@ namespace Ui {
 class VramViewer;
 }
 
-class VramViewer : public QWidget {
+class VramViewer : public QWidget, public PPUObserver {
   Q_OBJECT
 
  public:
@@ -31,9 +32,24 @@ class VramViewer : public QWidget {
   void renderBgViewport();
   void renderWinViewport();
 
+  void lineCaptured(const line_state_t &line) override;
+
+ protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
  private:
   Ui::VramViewer *ui;
   QImage vramDisplay, bgDisplay, winDisplay;
   CGB *cgb;
   bool running;
+
+  // scroll position of each line of the last frame
+  // and how many lines use each scroll value, the
+  // viewport is drawn at the most used values
+  uint8 lineScxs[SCREEN_PX_HEIGHT], lineScys[SCREEN_PX_HEIGHT];
+  uint8 scxCounts[BG_PX_DIM], scyCounts[BG_PX_DIM];
+  atomic<uint8> viewportScx, viewportScy;
+
+  static uint8 mostFrequent(const uint8 counts[BG_PX_DIM]);
 };